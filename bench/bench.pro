@@ -0,0 +1,9 @@
+TEMPLATE = app
+TARGET = thumbnailbox-bench
+CONFIG += console c++11 release
+CONFIG -= app_bundle
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+INCLUDEPATH += ../inc
+HEADERS += ../inc/thumbnailbox.hpp benchmark.hpp
+SOURCES += ../src/thumbnailbox.cpp benchmark.cpp main.cpp
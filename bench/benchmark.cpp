@@ -0,0 +1,582 @@
+#include "benchmark.hpp"
+
+/*! \class Benchmark
+ *
+ * \brief Benchmark measures the performance of a ThumbnailBox.
+ *
+ * The ThumbnailBox is filled with synthetic lists (External source type),
+ * requested images are delivered by the benchmark after every step,
+ * like an external loader would. Loading itself is not measured.
+ *
+ * Every result is written to stdout as one JSON object per line,
+ * times are in microseconds.
+ *
+ * Input recordings (see ThumbnailBox::startInputRecording()) can be
+ * replayed as well, see replay().
+ *
+ */
+
+static QString
+modeName(ThumbnailBox::RenderMode mode)
+{
+    return mode == ThumbnailBox::RenderMode::Painted ? "painted" : "widgets";
+}
+
+static int
+nextRandom(quint32 &state)
+{
+    //Same sequence with every Qt version (qrand() is deprecated)
+    state = state * 1103515245 + 12345;
+    return (state >> 16) & 0x7fff;
+}
+
+static QString
+formatName(QImage::Format format)
+{
+    switch (format)
+    {
+        case QImage::Format_RGB32: return "rgb32";
+        case QImage::Format_ARGB32: return "argb32";
+        case QImage::Format_ARGB32_Premultiplied: return "argb32_pm";
+        case QImage::Format_RGB888: return "rgb888";
+        case QImage::Format_Indexed8: return "indexed8";
+        default: return QString::number((int)format);
+    }
+}
+
+Benchmark::Benchmark(QObject *parent)
+         : QObject(parent),
+           _box(new ThumbnailBox(0)),
+           _out(stdout)
+{
+    //Window of a typical size, offscreen
+    _box->resize(1280, 800);
+    _box->setThumbSize(.12);
+    _box->show();
+
+    //Requested images are delivered after every step, see deliverRequested()
+    connect(_box,
+            SIGNAL(imagesRequested(const QStringList&)),
+            SLOT(collectRequests(const QStringList&)));
+}
+
+Benchmark::~Benchmark()
+{
+    delete _box;
+}
+
+/*!
+ * Runs all benchmarks, the list benchmarks for each list size.
+ */
+void
+Benchmark::run(const QList<int> &sizes, int iterations)
+{
+    benchShrink(iterations);
+    benchIngest(iterations);
+
+    foreach (int items, sizes)
+    {
+        benchUpdate(items, iterations);
+        benchScroll(items, iterations);
+        benchSelect(items, iterations);
+        benchHitRate(items, iterations);
+    }
+}
+
+void
+Benchmark::collectRequests(const QStringList &paths)
+{
+    _requested << paths;
+}
+
+QStringList
+Benchmark::syntheticList(int count)
+{
+    //Addresses of items, they don't exist (External)
+    QStringList list;
+    list.reserve(count);
+    for (int i = 0; i < count; i++)
+        list << QString("synthetic/%1.jpg").arg(i);
+    return list;
+}
+
+QStringList
+Benchmark::imageList(const QString &directory, int count)
+{
+    //Image files in the directory, repeated if there are fewer than count
+    QStringList filters;
+    filters << "*.jpg" << "*.jpeg" << "*.png" << "*.bmp" << "*.gif";
+    filters << "*.JPG" << "*.JPEG" << "*.PNG";
+    QDir dir(directory);
+    QStringList files = dir.entryList(filters, QDir::Files, QDir::Name);
+    QStringList list;
+    if (files.isEmpty()) return list;
+    list.reserve(count);
+    for (int i = 0; i < count; i++)
+        list << dir.absoluteFilePath(files.at(i % files.size()));
+    return list;
+}
+
+QImage
+Benchmark::syntheticImage(const QSize &size, QImage::Format format, int seed)
+{
+    //Some pattern, so it isn't one solid color
+    //Alpha varies if the format has an alpha channel
+    QImage image(size, QImage::Format_ARGB32);
+    bool alpha = format == QImage::Format_ARGB32 ||
+                 format == QImage::Format_ARGB32_Premultiplied;
+    for (int y = 0; y < size.height(); y++)
+    {
+        QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for (int x = 0; x < size.width(); x++)
+        {
+            line[x] = qRgba((x + seed) & 0xff, (2 * y + seed) & 0xff,
+                            (x ^ y) & 0xff, alpha ? (x + y) & 0xff : 0xff);
+        }
+    }
+    return image.convertToFormat(format);
+}
+
+void
+Benchmark::report(const QString &benchmark, const QString &fields)
+{
+    _out << "{\"benchmark\":\"" << benchmark << "\"," << fields << "}\n";
+    _out.flush();
+}
+
+void
+Benchmark::reportTimes(const QString &benchmark, const QString &fields,
+                       QVector<qint64> times)
+{
+    //Mean and percentiles (nanoseconds to microseconds)
+    if (times.isEmpty()) return;
+    std::sort(times.begin(), times.end());
+    qint64 total = 0;
+    foreach (qint64 time, times)
+        total += time;
+    int count = times.size();
+    double mean = (double)total / count / 1000;
+    double p50 = times.at(count * 50 / 100) / 1000.;
+    double p95 = times.at(qMin(count * 95 / 100, count - 1)) / 1000.;
+    double p99 = times.at(qMin(count * 99 / 100, count - 1)) / 1000.;
+    double max = times.last() / 1000.;
+
+    report(benchmark, fields + QString(",\"samples\":%1,\"mean_us\":%2,"
+                                       "\"p50_us\":%3,\"p95_us\":%4,"
+                                       "\"p99_us\":%5,\"max_us\":%6")
+                                       .arg(count)
+                                       .arg(mean, 0, 'f', 1)
+                                       .arg(p50, 0, 'f', 1)
+                                       .arg(p95, 0, 'f', 1)
+                                       .arg(p99, 0, 'f', 1)
+                                       .arg(max, 0, 'f', 1));
+}
+
+void
+Benchmark::deliverRequested()
+{
+    //Answer requests (like an external loader), not measured
+    //All previews are the same small image
+    static QImage preview = syntheticImage(QSize(96, 72),
+                                           QImage::Format_RGB32, 0);
+    QCoreApplication::processEvents(); //flush batched requests
+    if (_requested.isEmpty()) return;
+    QList<QImage> images;
+    for (int i = 0; i < _requested.size(); i++)
+        images << preview;
+    _box->cacheImages(_requested, images);
+    _requested.clear();
+    QCoreApplication::processEvents();
+}
+
+void
+Benchmark::waitForLoader()
+{
+    //Let the loader threads finish (real images), not measured
+    QElapsedTimer timer;
+    timer.start();
+    QCoreApplication::processEvents();
+    while (_box->pendingImageCount() && timer.elapsed() < 10000)
+    {
+        //Wait for delivered images (queued), at most 1 ms
+        QEventLoop loop;
+        QTimer::singleShot(1, &loop, SLOT(quit()));
+        loop.exec();
+    }
+}
+
+void
+Benchmark::wheel(int delta)
+{
+    #if QT_VERSION >= 0x050C00
+    QWheelEvent event(QPointF(10, 10), QPointF(10, 10), QPoint(),
+                      QPoint(0, delta), Qt::NoButton, Qt::NoModifier,
+                      Qt::NoScrollPhase, false);
+    #else
+    QWheelEvent event(QPoint(10, 10), delta, Qt::NoButton, Qt::NoModifier,
+                      Qt::Vertical);
+    #endif
+    QCoreApplication::sendEvent(_box, &event);
+}
+
+/*!
+ * Full update of the view (rebinding all visible thumbnails) and redraw.
+ */
+void
+Benchmark::benchUpdate(int items, int iterations)
+{
+    _box->setList(syntheticList(items), ThumbnailBox::SourceType::External);
+    _box->setCacheLimit(64);
+    deliverRequested();
+
+    QList<ThumbnailBox::RenderMode> modes;
+    modes << ThumbnailBox::RenderMode::Widgets;
+    modes << ThumbnailBox::RenderMode::Painted;
+    foreach (ThumbnailBox::RenderMode mode, modes)
+    {
+        _box->setRenderMode(mode);
+        deliverRequested();
+
+        QVector<qint64> times;
+        QElapsedTimer timer;
+        for (int i = 0; i < iterations; i++)
+        {
+            timer.start();
+            _box->updateThumbnails();
+            QCoreApplication::processEvents();
+            times << timer.nsecsElapsed();
+        }
+        reportTimes("update", QString("\"items\":%1,\"mode\":\"%2\"")
+                              .arg(items).arg(modeName(mode)), times);
+    }
+}
+
+/*!
+ * Wheel steps (down, then up again), by rows and smooth (a third of a row).
+ * Requested images are delivered after every step, not measured.
+ */
+void
+Benchmark::benchScroll(int items, int iterations)
+{
+    _box->setList(syntheticList(items), ThumbnailBox::SourceType::External);
+    _box->setCacheLimit(64);
+    deliverRequested();
+
+    QList<ThumbnailBox::RenderMode> modes;
+    modes << ThumbnailBox::RenderMode::Widgets;
+    modes << ThumbnailBox::RenderMode::Painted;
+    foreach (ThumbnailBox::RenderMode mode, modes)
+    {
+        for (int smooth = 0; smooth <= 1; smooth++)
+        {
+            _box->setRenderMode(mode);
+            _box->setSmoothScrollingEnabled(smooth);
+            _box->scrollToTop();
+            deliverRequested();
+
+            int delta = smooth ? 40 : 120;
+            QVector<qint64> times;
+            QElapsedTimer timer;
+            for (int i = 0; i < iterations * 2; i++)
+            {
+                timer.start();
+                wheel(i < iterations ? -delta : delta);
+                QCoreApplication::processEvents();
+                times << timer.nsecsElapsed();
+                deliverRequested();
+            }
+            reportTimes("scroll", QString("\"items\":%1,\"mode\":\"%2\","
+                                          "\"smooth\":%3")
+                                  .arg(items).arg(modeName(mode))
+                                  .arg(smooth ? "true" : "false"), times);
+        }
+    }
+    _box->setSmoothScrollingEnabled(false);
+}
+
+/*!
+ * Selecting the next item (which scrolls when it leaves the viewport).
+ */
+void
+Benchmark::benchSelect(int items, int iterations)
+{
+    _box->setList(syntheticList(items), ThumbnailBox::SourceType::External);
+    _box->setCacheLimit(64);
+    _box->setRenderMode(ThumbnailBox::RenderMode::Widgets);
+    deliverRequested();
+    _box->select(0, false);
+
+    QVector<qint64> times;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations * 4; i++)
+    {
+        timer.start();
+        _box->selectNext();
+        QCoreApplication::processEvents();
+        times << timer.nsecsElapsed();
+        deliverRequested();
+    }
+    reportTimes("select", QString("\"items\":%1").arg(items), times);
+}
+
+/*!
+ * Cache hits under scripted scroll patterns,
+ * without and with compressed cache (prefetching disabled).
+ * A lookup is a thumbnail bound to an item (see statistics()),
+ * thumbnails that are only moved by a scroll don't look anything up.
+ */
+void
+Benchmark::benchHitRate(int items, int iterations)
+{
+    _box->setList(syntheticList(items), ThumbnailBox::SourceType::External);
+    _box->setRenderMode(ThumbnailBox::RenderMode::Widgets);
+    _box->setPrefetchRows(0);
+    _box->setCacheLimit(8);
+
+    QStringList patterns;
+    patterns << "linear" << "pingpong" << "random";
+    QList<int> compressed_limits;
+    compressed_limits << 0 << 32;
+    foreach (int compressed_mb, compressed_limits)
+    {
+        _box->setCompressedCacheLimit(compressed_mb);
+        foreach (QString pattern, patterns)
+        {
+            _box->clearCache();
+            _box->scrollToTop();
+            deliverRequested();
+            _box->resetStatistics();
+            quint32 random = 1;
+
+            int steps = iterations * 4;
+            for (int i = 0; i < steps; i++)
+            {
+                int row = i;
+                if (pattern == "pingpong") row = i % 40 < 20 ? i % 20 :
+                                                               20 - i % 20;
+                else if (pattern == "random")
+                    row = nextRandom(random) % qMax(items / 10, 1);
+                _box->scrollToRow(row);
+                QCoreApplication::processEvents();
+                deliverRequested();
+            }
+            ThumbnailBox::Statistics statistics = _box->statistics();
+            qint64 misses = statistics.cache_misses;
+            qint64 lookups = statistics.cache_hits + misses;
+            double hit_rate = lookups ? 1 - (double)misses / lookups : 0;
+            report("hitrate", QString("\"items\":%1,\"pattern\":\"%2\","
+                                      "\"compressed_mb\":%3,\"steps\":%4,"
+                                      "\"lookups\":%5,\"misses\":%6,"
+                                      "\"hit_rate\":%7")
+                              .arg(items).arg(pattern).arg(compressed_mb)
+                              .arg(steps).arg(lookups).arg(misses)
+                              .arg(hit_rate, 0, 'f', 4));
+        }
+    }
+    _box->setCompressedCacheLimit(0);
+    _box->setPrefetchRows(2);
+}
+
+/*!
+ * Delivering images (1024x768) to cacheImage() and cacheImages(),
+ * which shrinks and caches them and redraws visible thumbnails.
+ */
+void
+Benchmark::benchIngest(int iterations)
+{
+    int count = qMax(iterations * 20, 64);
+    QStringList list = syntheticList(count);
+    _box->setList(list, ThumbnailBox::SourceType::External);
+    _box->setRenderMode(ThumbnailBox::RenderMode::Widgets);
+    _box->setCacheLimit(256);
+    QCoreApplication::processEvents();
+    _requested.clear();
+
+    QList<QImage> images;
+    for (int i = 0; i < 16; i++)
+        images << syntheticImage(QSize(1024, 768), QImage::Format_RGB32, i);
+
+    for (int batch = 0; batch <= 1; batch++)
+    {
+        _box->clearCache();
+        QElapsedTimer timer;
+        timer.start();
+        if (batch)
+        {
+            for (int i = 0; i < count; i += 64)
+            {
+                QStringList paths = list.mid(i, 64);
+                QList<QImage> batch_images;
+                for (int j = 0; j < paths.size(); j++)
+                    batch_images << images.at((i + j) % images.size());
+                _box->cacheImages(paths, batch_images);
+            }
+        }
+        else
+        {
+            for (int i = 0; i < count; i++)
+                _box->cacheImage(list.at(i), images.at(i % images.size()));
+        }
+        QCoreApplication::processEvents();
+        qint64 time = timer.nsecsElapsed();
+
+        report("ingest", QString("\"api\":\"%1\",\"images\":%2,"
+                                 "\"total_ms\":%3,\"images_per_s\":%4")
+                         .arg(batch ? "batch" : "single").arg(count)
+                         .arg(time / 1e6, 0, 'f', 1)
+                         .arg(count / (time / 1e9), 0, 'f', 0));
+    }
+    _box->clearCache();
+}
+
+/*!
+ * Shrinking a 12 MP image to 256 px, per format,
+ * compared to QImage::scaled() (fast and smooth).
+ */
+void
+Benchmark::benchShrink(int iterations)
+{
+    QList<QImage::Format> formats;
+    formats << QImage::Format_RGB32 << QImage::Format_ARGB32;
+    formats << QImage::Format_ARGB32_Premultiplied << QImage::Format_RGB888;
+    formats << QImage::Format_Indexed8;
+    QSize size(256, 256);
+    int count = qMax(iterations / 5, 3);
+
+    foreach (QImage::Format format, formats)
+    {
+        QImage image = syntheticImage(QSize(4000, 3000), format, 0);
+        for (int method = 0; method < 3; method++)
+        {
+            QVector<qint64> times;
+            QElapsedTimer timer;
+            for (int i = 0; i < count; i++)
+            {
+                timer.start();
+                QImage shrunk;
+                if (method == 0)
+                    shrunk = ThumbnailBox::shrinkImage(image, size);
+                else
+                    shrunk = image.scaled(size, Qt::KeepAspectRatio,
+                                          method == 1 ?
+                                          Qt::FastTransformation :
+                                          Qt::SmoothTransformation);
+                times << timer.nsecsElapsed();
+            }
+            QString name = method == 0 ? "shrink" :
+                           method == 1 ? "qt_fast" : "qt_smooth";
+            reportTimes("shrink", QString("\"format\":\"%1\","
+                                          "\"method\":\"%2\"")
+                                  .arg(formatName(format)).arg(name), times);
+        }
+    }
+}
+
+/*!
+ * Replays an input recording, one event per frame, as fast as possible.
+ * A frame is the event and the processing (drawing) that follows it.
+ *
+ * Images are synthetic (External) unless an image directory is given,
+ * then its files are loaded (Local) by the loader threads.
+ * Loading is not measured, it's finished after every frame,
+ * so the same recording always leads through the same states.
+ * Frame times are reported per event type and for all events,
+ * followed by the cache statistics of the run.
+ * Returns false if the recording or the images could not be read.
+ */
+bool
+Benchmark::replay(const QString &file, const QString &image_dir)
+{
+    QFile input(file);
+    if (!input.open(QIODevice::ReadOnly | QIODevice::Text)) return false;
+    bool local = !image_dir.isEmpty();
+    if (local && imageList(image_dir, 1).isEmpty()) return false;
+
+    //Same settings as the recording, which starts with the state
+    QScrollBar *scrollbar = _box->findChild<QScrollBar*>();
+    _box->setCacheLimit(64);
+    _box->resetStatistics();
+
+    QMap<QString, QVector<qint64> > times;
+    QVector<qint64> all_times;
+    QElapsedTimer timer;
+    while (!input.atEnd())
+    {
+        //Time, event, arguments
+        QString line = QString::fromUtf8(input.readLine()).simplified();
+        if (line.startsWith("#")) continue;
+        QStringList fields = line.split(" ");
+        if (fields.size() < 3) continue;
+        QString event = fields.at(1);
+        int value = fields.at(2).toInt();
+
+        timer.start();
+        if (event == "list")
+        {
+            if (local)
+                _box->setList(imageList(image_dir, value),
+                              ThumbnailBox::SourceType::Local);
+            else
+                _box->setList(syntheticList(value),
+                              ThumbnailBox::SourceType::External);
+        }
+        else if (event == "resize")
+        {
+            _box->resize(value, fields.value(3).toInt());
+        }
+        else if (event == "size")
+        {
+            _box->setThumbSize(fields.at(2).toDouble());
+        }
+        else if (event == "scroll")
+        {
+            scrollbar->setValue(value);
+        }
+        else if (event == "select")
+        {
+            _box->select(value);
+        }
+        else if (event == "smooth")
+        {
+            _box->setSmoothScrollingEnabled(value);
+        }
+        else if (event == "mode")
+        {
+            _box->setRenderMode(fields.at(2) == "painted" ?
+                                ThumbnailBox::RenderMode::Painted :
+                                ThumbnailBox::RenderMode::Widgets);
+        }
+        else
+        {
+            continue; //unknown
+        }
+        QCoreApplication::processEvents();
+        qint64 time = timer.nsecsElapsed();
+        times[event] << time;
+        all_times << time;
+
+        if (local) waitForLoader();
+        else deliverRequested();
+    }
+
+    QString source = local ? "local" : "synthetic";
+    foreach (QString event, times.keys())
+    {
+        reportTimes("replay", QString("\"images\":\"%1\",\"event\":\"%2\"")
+                              .arg(source).arg(event), times.value(event));
+    }
+    reportTimes("replay", QString("\"images\":\"%1\",\"event\":\"all\"")
+                          .arg(source), all_times);
+
+    ThumbnailBox::Statistics statistics = _box->statistics();
+    report("replay_cache", QString("\"images\":\"%1\",\"hits\":%2,"
+                                   "\"misses\":%3,\"evictions\":%4,"
+                                   "\"requests\":%5,\"cancelled\":%6")
+                           .arg(source)
+                           .arg(statistics.cache_hits)
+                           .arg(statistics.cache_misses)
+                           .arg(statistics.cache_evictions)
+                           .arg(statistics.requests_issued)
+                           .arg(statistics.requests_cancelled));
+    return true;
+}
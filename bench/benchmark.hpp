@@ -0,0 +1,99 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <algorithm>
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+#include <QTextStream>
+#include <QStringList>
+#include <QVector>
+#include <QImage>
+#include <QWheelEvent>
+#include <QFile>
+#include <QDir>
+#include <QMap>
+#include <QScrollBar>
+
+#include "thumbnailbox.hpp"
+
+class Benchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    Benchmark(QObject *parent = 0);
+
+    ~Benchmark();
+
+    void
+    run(const QList<int> &sizes, int iterations);
+
+    bool
+    replay(const QString &file, const QString &image_dir = QString());
+
+private slots:
+
+    void
+    collectRequests(const QStringList &paths);
+
+private:
+
+    ThumbnailBox
+    *_box;
+
+    QStringList
+    _requested;
+
+    QTextStream
+    _out;
+
+    static QStringList
+    syntheticList(int count);
+
+    static QImage
+    syntheticImage(const QSize &size, QImage::Format format, int seed);
+
+    static QStringList
+    imageList(const QString &directory, int count);
+
+    void
+    report(const QString &benchmark, const QString &fields);
+
+    void
+    reportTimes(const QString &benchmark, const QString &fields,
+                QVector<qint64> times);
+
+    void
+    deliverRequested();
+
+    void
+    waitForLoader();
+
+    void
+    wheel(int delta);
+
+    void
+    benchUpdate(int items, int iterations);
+
+    void
+    benchScroll(int items, int iterations);
+
+    void
+    benchSelect(int items, int iterations);
+
+    void
+    benchHitRate(int items, int iterations);
+
+    void
+    benchIngest(int iterations);
+
+    void
+    benchShrink(int iterations);
+
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include "benchmark.hpp"
+
+//Usage: thumbnailbox-bench [--items 1000,10000,...] [--iterations 50]
+//       thumbnailbox-bench --replay recording.txt [--images directory]
+//Results are written to stdout, one JSON object per line.
+
+int
+main(int argc, char *argv[])
+{
+    //No display needed
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+
+    //Options
+    QList<int> sizes;
+    sizes << 1000 << 10000 << 100000 << 1000000;
+    int iterations = 50;
+    QString replay_file;
+    QString image_dir;
+    QStringList args = app.arguments();
+    for (int i = 1; i + 1 < args.size(); i++)
+    {
+        if (args.at(i) == "--items")
+        {
+            sizes.clear();
+            foreach (QString size, args.at(++i).split(","))
+                sizes << size.toInt();
+        }
+        else if (args.at(i) == "--iterations")
+        {
+            iterations = qMax(args.at(++i).toInt(), 1);
+        }
+        else if (args.at(i) == "--replay")
+        {
+            replay_file = args.at(++i);
+        }
+        else if (args.at(i) == "--images")
+        {
+            image_dir = args.at(++i);
+        }
+    }
+
+    //Replay recorded input instead of the benchmarks
+    Benchmark benchmark;
+    if (!replay_file.isEmpty())
+    {
+        if (benchmark.replay(replay_file, image_dir)) return 0;
+        qWarning() << "Cannot replay" << replay_file;
+        return 1;
+    }
+    benchmark.run(sizes, iterations);
+
+    return 0;
+}
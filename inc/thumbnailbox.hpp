@@ -2,6 +2,9 @@
 #define THUMBNAILBOX_HPP
 
 #include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <functional>
 
 #include <QDebug>
 #include <QFrame>
@@ -18,8 +21,44 @@
 #include <QMenu>
 #include <QCache>
 #include <QPointer>
-
-namespace ThumbnailBoxComponents { class Thumb; }
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPainter>
+#include <qdrawutil.h>
+#include <QHash>
+#include <QSet>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QImageReader>
+#include <QTransform>
+#include <QtEndian>
+#include <QBuffer>
+#include <QDataStream>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+
+namespace ThumbnailBoxComponents
+{
+    class Thumb;
+    class CachedImage;
+    class DiskCache;
+    class Tracer;
+    class TraceSpan;
+    class InputRecorder;
+    class Loader;
+    class LoadJob;
+    class CompressJob;
+    class Validator;
+    class ValidateJob;
+    class ImageLoader;
+    class FunctionImageLoader;
+    class ItemProvider;
+    class ListProvider;
+}
 
 class ThumbnailBox : public QFrame
 {
@@ -31,13 +70,135 @@ public:
     {
         Local,
         LoaderFunction,
-        External
+        External,
+        LoaderObject
+    };
+
+    enum class RenderMode
+    {
+        Widgets,
+        Painted
     };
 
     typedef ThumbnailBoxComponents::Thumb Thumb;
 
+    typedef ThumbnailBoxComponents::CachedImage CachedImage;
+
+    typedef ThumbnailBoxComponents::DiskCache DiskCache;
+
+    typedef ThumbnailBoxComponents::Tracer Tracer;
+
+    typedef ThumbnailBoxComponents::TraceSpan TraceSpan;
+
+    typedef ThumbnailBoxComponents::InputRecorder InputRecorder;
+
+    typedef ThumbnailBoxComponents::Loader Loader;
+
+    typedef ThumbnailBoxComponents::Validator Validator;
+
+    typedef ThumbnailBoxComponents::ImageLoader ImageLoader;
+
+    typedef ThumbnailBoxComponents::FunctionImageLoader FunctionImageLoader;
+
+    typedef ThumbnailBoxComponents::ItemProvider ItemProvider;
+
+    typedef ThumbnailBoxComponents::ListProvider ListProvider;
+
+    struct Histogram
+    {
+        //Bucket i counts samples below 2^i microseconds,
+        //the last one counts everything above as well
+        QVector<qint64>
+        buckets;
+
+        qint64
+        count;
+
+        qint64
+        total_us;
+
+        qint64
+        max_us;
+
+        Histogram();
+
+        void
+        add(qint64 microseconds);
+
+        void
+        merge(const Histogram &other);
+
+        qint64
+        mean() const;
+
+        qint64
+        percentile(double fraction) const;
+    };
+
+    struct Statistics
+    {
+        //Lookups of visible thumbnails, see statistics()
+        qint64
+        cache_hits;
+
+        qint64
+        cache_misses;
+
+        qint64
+        compressed_hits;
+
+        qint64
+        derived_hits;
+
+        qint64
+        cache_evictions;
+
+        qint64
+        cache_items;
+
+        qint64
+        cache_bytes;
+
+        qint64
+        compressed_bytes;
+
+        qint64
+        pixmap_bytes;
+
+        qint64
+        requests_issued;
+
+        qint64
+        requests_deduplicated;
+
+        qint64
+        requests_cancelled;
+
+        qint64
+        requests_failed;
+
+        qint64
+        updates;
+
+        qint64
+        thumbs_created;
+
+        Histogram
+        decode_time;
+
+        Histogram
+        shrink_time;
+
+        Histogram
+        update_time;
+
+        Statistics();
+    };
+
     ThumbnailBox(QWidget *parent);
 
+    ~ThumbnailBox();
+
 signals:
 
     void
@@ -82,11 +243,42 @@ signals:
     void
     imageRequested(const QString &path);
 
+    void
+    imagesRequested(const QStringList &paths);
+
     void
     imageCached(const QString &path = "");
 
+    void
+    imageRequestCancelled(const QString &path);
+
+    void
+    validationProgress(int checked, int total);
+
+    void
+    listValidated();
+
+    void
+    statisticsUpdated(const ThumbnailBox::Statistics &statistics);
+
 private:
 
+    struct PaintedThumb
+    {
+        //Everything a thumbnail needs to be drawn (Painted mode)
+        QString
+        path;
+
+        QString
+        title; //elided
+
+        QColor
+        color;
+
+        QPixmap
+        pixmap;
+    };
+
     QPalette
     _original_palette;
 
@@ -96,8 +288,11 @@ private:
     int
     _index;
 
-    QStringList
-    _list;
+    ListProvider
+    *_list_provider;
+
+    QPointer<ItemProvider>
+    _provider;
 
     double
     _size;
@@ -117,18 +312,48 @@ private:
     QMap<QString, int>
     _file_colors;
 
-    QCache<QString, QImage>
+    mutable QCache<QString, QByteArray>
+    _compressed_cache; //destroyed after _pixcache, which spills into it
+
+    mutable QCache<QString, CachedImage>
     _pixcache;
 
+    mutable QCache<QString, QPixmap>
+    _pixmapcache;
+
     SourceType
     _source_type;
 
     QImage
     (*_image_loader_function)(const QString&);
 
+    QPointer<ImageLoader>
+    _image_loader;
+
+    FunctionImageLoader
+    *_function_image_loader;
+
+    bool
+    _embedded_thumbnails;
+
     QList<QAction*>
     _actions;
 
+    Loader
+    *_loader;
+
+    bool
+    _background_validation;
+
+    Validator
+    *_validator;
+
+    QSet<QString>
+    _invalid_paths;
+
+    bool
+    _invalid_paths_scheduled;
+
     QWidget
     *thumbcontainer;
 
@@ -144,6 +369,90 @@ private:
     QMap<int, QPointer<Thumb>>
     _visible_thumbnails_in_viewport;
 
+    QMultiHash<QString, int>
+    _visible_paths;
+
+    QHash<int, PaintedThumb>
+    _painted_thumbs;
+
+    QList<Thumb*>
+    _thumb_pool;
+
+    int
+    _thumbs_created;
+
+    int
+    _thumbs_reused;
+
+    RenderMode
+    _render_mode;
+
+    int
+    _viewport_first_index;
+
+    int
+    _viewport_columns;
+
+    int
+    _viewport_thumb_size;
+
+    int
+    _prefetch_rows;
+
+    int
+    _last_scroll_pos;
+
+    int
+    _scroll_direction;
+
+    bool
+    _smooth_scrolling;
+
+    bool
+    _scroll_only;
+
+    int
+    _viewport_offset;
+
+    int
+    _viewport_scroll_pos;
+
+    int
+    _wheel_delta;
+
+    QHash<QString, int>
+    _wanted_paths;
+
+    QHash<QString, int>
+    _requested_paths;
+
+    QStringList
+    _requested_batch;
+
+    QSet<QString>
+    _failed_paths;
+
+    mutable Statistics
+    _statistics;
+
+    mutable qint64
+    _cache_dropped;
+
+    mutable QHash<QString, int>
+    _compressing;
+
+    mutable int
+    _compress_ticket;
+
+    qint64
+    _cache_removed;
+
+    QTimer
+    *_statistics_timer;
+
+    InputRecorder
+    *_input_recorder;
+
     int
     availableWidth() const;
 
@@ -159,6 +468,9 @@ private:
     int
     topRow() const;
 
+    int
+    rowHeight() const;
+
     int
     bottomRow() const;
 
@@ -174,17 +486,88 @@ private:
     QPointer<Thumb>
     thumbAtIndex(int index) const;
 
+    QRect
+    thumbRect(int index) const;
+
+    int
+    indexAt(const QPoint &pos) const;
+
+    void
+    paintThumbnails(const QRect &rect);
+
+    void
+    clickThumbnail(QMouseEvent *event);
+
+    Thumb*
+    createThumb();
+
+    void
+    bindThumb(Thumb *thumb, int index);
+
+    void
+    bindPaintedThumb(int index);
+
+    QString
+    itemTitle(int index, const QString &path) const;
+
+    void
+    styleThumb(Thumb *thumb, int index);
+
+    bool
+    storeImage(const QString &file, const QImage &image, int &level);
+
+    void
+    recordItems();
+
+    void
+    releaseImageLoader();
+
     QColor
     fileColor(const QString &file) const;
 
+    QList<int>
+    previewLevels() const;
+
+    int
+    thumbDeviceWidth() const;
+
+    int
+    previewLevel() const;
+
+    static QString
+    cacheKey(const QString &file, int level);
+
+    bool
+    isCached(const QString &file) const;
+
+    void
+    insertCachedImage(const QString &key, const QImage &image) const;
+
+    friend class ThumbnailBoxComponents::CachedImage;
+
+    void
+    dropCachedImage(const QString &key, const QImage &image) const;
+
+    QImage
+    cachedImage(const QString &file, int level) const;
+
     QImage
     cachedImage(const QString &file) const;
 
     QPixmap
-    cachedPixmap(const QString &file) const;
+    cachedPixmap(const QString &file, bool *current = 0) const;
+
+    Tracer*
+    tracer() const;
+
+    void
+    requestImage(const QString &path, int priority = 0);
+
+    void
+    cancelRequests();
 
     void
-    requestImage(const QString &path);
+    prefetchImages(int top_row, int bottom_row, int cols);
 
 private slots:
 
@@ -194,6 +577,9 @@ private slots:
     void
     wheelEvent(QWheelEvent *event);
 
+    bool
+    eventFilter(QObject *object, QEvent *event);
+
     void
     showMenu(int index, const QPoint &pos);
 
@@ -203,17 +589,62 @@ private slots:
     void
     updateThumbnail(const QString &file);
 
+    void
+    restyleThumbnail(int index);
+
+    void
+    restyleThumbnail(const QString &file);
+
+    void
+    scrollThumbnails(int value);
+
+    void
+    collectInvalidPaths(const QStringList &paths, int checked, int total);
+
+    void
+    removeInvalidPaths();
+
+    void
+    finishValidation();
+
+    void
+    flushImageRequests();
+
+    void
+    resetItems();
+
+    void
+    updateItems(int first, int count);
+
+    void
+    emitStatistics();
+
+    void
+    storeCompressed(const QString &key, int ticket, const QByteArray &data);
+
 public:
 
     SourceType
     sourceType() const;
 
+    RenderMode
+    renderMode() const;
+
     QImage
     shrinkImage(const QImage &original_image) const;
 
+    static QImage
+    shrinkImage(const QImage &original_image, const QSize &max_size);
+
+    static QImage
+    downscaleImage(const QImage &original_image, const QSize &size);
+
     QStringList
     list() const;
 
+    ItemProvider*
+    itemProvider() const;
+
     int
     count() const;
 
@@ -250,6 +681,54 @@ public:
     bool
     isMenuEnabled() const;
 
+    int
+    prefetchRows() const;
+
+    int
+    thumbsCreated() const;
+
+    int
+    thumbsReused() const;
+
+    int
+    loaderThreadCount() const;
+
+    int
+    pendingImageCount() const;
+
+    bool
+    embeddedThumbnailsEnabled() const;
+
+    QString
+    diskCacheDirectory() const;
+
+    bool
+    smoothScrollingEnabled() const;
+
+    bool
+    backgroundValidationEnabled() const;
+
+    bool
+    isValidating() const;
+
+    Statistics
+    statistics() const;
+
+    int
+    statisticsInterval() const;
+
+    bool
+    isTraceEnabled() const;
+
+    bool
+    writeTrace(const QString &file) const;
+
+    bool
+    startInputRecording(const QString &file);
+
+    bool
+    isRecordingInput() const;
+
 public slots:
 
     void
@@ -270,6 +749,48 @@ public slots:
     void
     setCacheLimit(int max_mb);
 
+    void
+    setCompressedCacheLimit(int max_mb);
+
+    void
+    setPrefetchRows(int rows);
+
+    void
+    setRenderMode(RenderMode mode);
+
+    void
+    setLoaderThreadCount(int count);
+
+    void
+    setDiskCache(const QString &directory, int max_mb = 100);
+
+    void
+    setEmbeddedThumbnailsEnabled(bool enable);
+
+    void
+    clearDiskCache();
+
+    void
+    setSmoothScrollingEnabled(bool enable);
+
+    void
+    setBackgroundValidationEnabled(bool enable);
+
+    void
+    setStatisticsInterval(int msec);
+
+    void
+    resetStatistics();
+
+    void
+    setTraceEnabled(bool enable);
+
+    void
+    clearTrace();
+
+    void
+    stopInputRecording();
+
     void
     addMenuItem(QAction *action);
 
@@ -297,6 +818,9 @@ public slots:
     void
     cacheImage(const QString &file, const QImage &image);
 
+    void
+    cacheImages(const QStringList &files, const QList<QImage> &images);
+
     void
     scrollToRow(int row);
 
@@ -347,6 +871,13 @@ public slots:
     #if !defined(Q_MOC_RUN)
     void
     setImageSource(QImage(*loader)(const QString&));
+
+    void
+    setImageSource(ImageLoader *loader);
+
+    void
+    setImageSource(const std::function<QImage(const QString&,
+                                              const QSize&)> &loader);
     #endif
 
     void
@@ -363,13 +894,22 @@ public slots:
     setList(const QStringList &paths, const QString &selected,
         SourceType type);
 
+    bool
+    setItemProvider(ItemProvider *provider,
+                    SourceType type = SourceType::Local);
+
     #if !defined(Q_MOC_RUN)
     bool
     setList(const QStringList &remote_paths, QImage(*loader)(const QString&));
+
+    bool
+    setList(const QStringList &remote_paths, ImageLoader *loader);
     #endif
 
 };
 
+Q_DECLARE_METATYPE(ThumbnailBox::Statistics)
+
 class ThumbnailBoxComponents::Thumb : public QFrame
 {
     Q_OBJECT
@@ -401,8 +941,17 @@ public:
     
     Thumb(int index, QWidget *parent = 0);
 
+    QString
+    path() const;
+
 public slots:
 
+    void
+    setIndex(int index);
+
+    void
+    setPath(const QString &path);
+
     void
     setPixmap(const QPixmap &preview);
 
@@ -419,6 +968,9 @@ private:
     int
     index;
 
+    QString
+    item_path; //path, uri
+
     QLabel
     *lbl_preview;
 
@@ -427,4 +979,688 @@ private:
 
 };
 
+class ThumbnailBoxComponents::CachedImage
+{
+public:
+
+    CachedImage(const QString &key, const QImage &image,
+                const ThumbnailBox *box = 0);
+
+    ~CachedImage();
+
+    QImage
+    image() const;
+
+    void
+    discard();
+
+    static QByteArray
+    compress(const QImage &image);
+
+    static QImage
+    decompress(const QByteArray &data);
+
+private:
+
+    QString
+    _key;
+
+    QImage
+    _image;
+
+    const ThumbnailBox
+    *_box;
+
+};
+
+class ThumbnailBoxComponents::DiskCache
+{
+public:
+
+    DiskCache();
+
+    QString
+    directory() const;
+
+    void
+    setDirectory(const QString &directory);
+
+    qint64
+    limit() const;
+
+    void
+    setLimit(qint64 max_bytes);
+
+    bool
+    isEnabled() const;
+
+    QImage
+    load(const QFileInfo &file, const QSize &max_size);
+
+    void
+    store(const QFileInfo &file, const QSize &max_size, const QImage &image);
+
+    void
+    clear();
+
+private:
+
+    mutable QMutex
+    _mutex;
+
+    QString
+    _directory;
+
+    qint64
+    _limit;
+
+    qint64
+    _total;
+
+    qint64
+    _sequence;
+
+    QHash<QString, QPair<qint64, qint64>>
+    _entries;
+
+    QMap<qint64, QString>
+    _lru;
+
+    static QString
+    entryName(const QFileInfo &file, const QSize &max_size);
+
+    void
+    touch(const QString &name);
+
+    void
+    remove(const QString &name);
+
+    void
+    trim();
+
+};
+
+class ThumbnailBoxComponents::Tracer
+{
+public:
+
+    struct Event
+    {
+        const char
+        *name;
+
+        qint64
+        start_us;
+
+        qint64
+        duration_us;
+
+        quint64
+        thread;
+
+        QString
+        path;
+
+        int
+        index;
+    };
+
+    Tracer();
+
+    bool
+    isEnabled() const;
+
+    void
+    setEnabled(bool enable);
+
+    qint64
+    now() const;
+
+    void
+    add(const char *name, qint64 start_us, qint64 duration_us,
+        const QString &path = QString(), int index = -1);
+
+    int
+    count() const;
+
+    void
+    clear();
+
+    bool
+    write(const QString &file) const;
+
+private:
+
+    mutable QMutex
+    _mutex;
+
+    QElapsedTimer
+    _clock;
+
+    bool
+    _enabled;
+
+    quint64
+    _gui_thread;
+
+    int
+    _limit;
+
+    QVector<Event>
+    _events;
+
+    static quint64
+    currentThread();
+
+    static QByteArray
+    jsonString(const QString &text);
+
+};
+
+class ThumbnailBoxComponents::TraceSpan
+{
+public:
+
+    TraceSpan(Tracer *tracer, const char *name,
+              const QString &path = QString(), int index = -1);
+
+    ~TraceSpan();
+
+private:
+
+    Tracer
+    *tracer;
+
+    const char
+    *name;
+
+    QString
+    path;
+
+    int
+    index;
+
+    qint64
+    start;
+
+};
+
+class ThumbnailBoxComponents::InputRecorder
+{
+public:
+
+    InputRecorder();
+
+    bool
+    isRecording() const;
+
+    bool
+    start(const QString &file);
+
+    void
+    stop();
+
+    void
+    record(const QString &event);
+
+private:
+
+    QFile
+    _file;
+
+    QElapsedTimer
+    _clock;
+
+};
+
+class ThumbnailBoxComponents::Loader : public QObject
+{
+    Q_OBJECT
+
+signals:
+
+    void
+    imageLoaded(const QString &path, const QImage &image);
+
+    void
+    loaded(const QString &path, const QImage &image);
+
+    void
+    compressed(const QString &key, int ticket, const QByteArray &data);
+
+public:
+
+    struct Request
+    {
+        QString
+        path;
+
+        int
+        priority;
+
+        ThumbnailBox::SourceType
+        type;
+
+        QImage
+        (*function)(const QString&);
+
+        QSize
+        max_size;
+
+        DiskCache
+        *disk_cache;
+
+        ImageLoader
+        *image_loader;
+
+        Tracer
+        *tracer;
+
+        int
+        min_size;
+
+        bool
+        embedded_thumbnails;
+    };
+
+    struct Timing
+    {
+        //Time spent on the image in microseconds, -1 if not done
+        qint64
+        decode_us;
+
+        qint64
+        shrink_us;
+
+        Timing();
+    };
+
+    Loader(QObject *parent = 0);
+
+    ~Loader();
+
+    static QImage
+    loadImage(const Request &request, Timing *timing = 0);
+
+    static QImage
+    loadFile(const Request &request, Timing *timing);
+
+    static bool
+    readExif(const QString &path, int &orientation, QByteArray *thumbnail);
+
+    static bool
+    parseExif(const QByteArray &tiff, int &orientation, QByteArray *thumbnail);
+
+    static QImage
+    orientImage(const QImage &image, int orientation);
+
+    static QImage
+    decodeImage(const QString &path, const QSize &max_size);
+
+    static void
+    trace(const Request &request, qint64 start_us, const Timing &timing);
+
+    int
+    threadCount() const;
+
+    void
+    setThreadCount(int count);
+
+    void
+    enqueue(const Request &request);
+
+    void
+    compress(const QString &key, int ticket, const QImage &image);
+
+    QStringList
+    retain(const QHash<QString, int> &wanted);
+
+    void
+    releaseImageLoader(ImageLoader *image_loader, bool destroy);
+
+    void
+    clear();
+
+    DiskCache*
+    diskCache();
+
+    Tracer*
+    tracer();
+
+    void
+    addTiming(const Timing &timing);
+
+    void
+    timing(ThumbnailBox::Histogram &decode_time,
+           ThumbnailBox::Histogram &shrink_time) const;
+
+    void
+    resetTiming();
+
+private slots:
+
+    void
+    deliver(const QString &path, const QImage &image);
+
+private:
+
+    friend class LoadJob;
+
+    friend class CompressJob;
+
+    mutable QMutex
+    _mutex;
+
+    QList<Request>
+    _queue;
+
+    int
+    _jobs;
+
+    int
+    _thread_count;
+
+    QHash<ImageLoader*, int>
+    _busy_loaders;
+
+    QSet<ImageLoader*>
+    _retired_loaders;
+
+    DiskCache
+    _disk_cache;
+
+    Tracer
+    _tracer;
+
+    QThreadPool
+    _pool;
+
+    ThumbnailBox::Histogram
+    _decode_time;
+
+    ThumbnailBox::Histogram
+    _shrink_time;
+
+    bool
+    takeRequest(Request &request);
+
+    QStringList
+    takeBatch(const Request &request);
+
+    void
+    finishBatch(const Request &request);
+
+    void
+    finishRequest(const QString &path, const QImage &image);
+
+    void
+    finishCompression(const QString &key, int ticket, const QByteArray &data);
+
+};
+
+class ThumbnailBoxComponents::LoadJob : public QRunnable
+{
+public:
+
+    LoadJob(Loader *loader);
+
+    void
+    run();
+
+private:
+
+    Loader
+    *loader;
+
+};
+
+class ThumbnailBoxComponents::CompressJob : public QRunnable
+{
+public:
+
+    CompressJob(Loader *loader, const QString &key, int ticket,
+                const QImage &image);
+
+    void
+    run();
+
+private:
+
+    Loader
+    *loader;
+
+    QString
+    key;
+
+    int
+    ticket;
+
+    QImage
+    image;
+
+};
+
+class ThumbnailBoxComponents::Validator : public QObject
+{
+    Q_OBJECT
+
+signals:
+
+    void
+    validated(const QStringList &invalid_paths, int checked, int total);
+
+    void
+    finished();
+
+    void
+    checked(int generation, const QStringList &invalid_paths, int count);
+
+public:
+
+    Validator(QObject *parent = 0);
+
+    ~Validator();
+
+    static bool
+    isValidPath(const QString &path, bool directories);
+
+    bool
+    isRunning() const;
+
+    void
+    start(const QStringList &paths, bool directories);
+
+    void
+    cancel();
+
+private slots:
+
+    void
+    deliver(int generation, const QStringList &invalid_paths, int count);
+
+private:
+
+    friend class ValidateJob;
+
+    mutable QMutex
+    _mutex;
+
+    int
+    _generation;
+
+    int
+    _checked;
+
+    int
+    _total;
+
+    QThreadPool
+    _pool;
+
+    bool
+    isCurrent(int generation) const;
+
+    void
+    finishChunk(int generation, const QStringList &invalid_paths, int count);
+
+};
+
+class ThumbnailBoxComponents::ValidateJob : public QRunnable
+{
+public:
+
+    ValidateJob(Validator *validator, int generation,
+                const QStringList &paths, bool directories);
+
+    void
+    run();
+
+private:
+
+    Validator
+    *validator;
+
+    int
+    generation;
+
+    QStringList
+    paths;
+
+    bool
+    directories;
+
+};
+
+class ThumbnailBoxComponents::ImageLoader : public QObject
+{
+    Q_OBJECT
+
+signals:
+
+    void
+    loaded(const QStringList &paths, const QList<QImage> &images);
+
+public:
+
+    ImageLoader(QObject *parent = 0);
+
+    virtual int
+    batchSize() const;
+
+    virtual void
+    load(const QStringList &paths, const QSize &size) = 0;
+
+protected:
+
+    void
+    deliver(const QStringList &paths, const QList<QImage> &images);
+
+    void
+    deliver(const QString &path, const QImage &image);
+
+};
+
+class ThumbnailBoxComponents::FunctionImageLoader : public ImageLoader
+{
+public:
+
+    typedef std::function<QImage(const QString&, const QSize&)> Function;
+
+    FunctionImageLoader(const Function &function, QObject *parent = 0);
+
+    void
+    load(const QStringList &paths, const QSize &size);
+
+private:
+
+    Function
+    _function;
+
+};
+
+class ThumbnailBoxComponents::ItemProvider : public QObject
+{
+    Q_OBJECT
+
+signals:
+
+    void
+    itemsReset();
+
+    void
+    itemsChanged(int first, int count);
+
+public:
+
+    ItemProvider(QObject *parent = 0);
+
+    virtual int
+    count() const = 0;
+
+    virtual QString
+    path(int index) const = 0;
+
+    virtual QString
+    title(int index) const;
+
+    virtual int
+    indexOf(const QString &path) const;
+
+};
+
+class ThumbnailBoxComponents::ListProvider : public ItemProvider
+{
+public:
+
+    ListProvider(QObject *parent = 0);
+
+    QStringList
+    list() const;
+
+    void
+    setList(const QStringList &list);
+
+    int
+    remove(const QSet<QString> &paths);
+
+    int
+    count() const;
+
+    QString
+    path(int index) const;
+
+    int
+    indexOf(const QString &path) const;
+
+private:
+
+    struct Entry
+    {
+        int
+        directory;
+
+        int
+        offset;
+
+        int
+        length;
+    };
+
+    QStringList
+    _directories;
+
+    QString
+    _names;
+
+    QVector<Entry>
+    _entries;
+
+    QVector<QPair<uint, int>>
+    _index;
+
+    bool
+    matches(int index, const QString &path) const;
+
+};
+
 #endif
@@ -1,11 +1,27 @@
 #include "thumbnailbox.hpp"
 
+//SIMD paths of the downscaler, see downscaleImage()
+//SSE2 is always available on x86-64, AVX2 is detected at runtime
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define THUMBNAILBOX_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(THUMBNAILBOX_SSE2) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define THUMBNAILBOX_AVX2
+#include <immintrin.h>
+#endif
+
 /*! \class ThumbnailBox
  *
  * \brief ThumbnailBox is a Qt widget that shows thumbnails of files.
  *
  * A list of (image) files can be provided, see setList().
  * This list is essentially a list of address strings.
+ * Huge catalogs can be shown through an item provider instead,
+ * which is only asked for the items near the viewport,
+ * see setItemProvider() and ItemProvider.
  * Different image source types can be defined.
  * The default type is Local, which means previews are loaded directly
  * by this module. This works for local image files only.
@@ -16,8 +32,20 @@
  * A loader function (reference) can be provided (type LoaderFunction).
  * In this case, this function is called whenever a preview is needed.
  * The function must take the image address and return a QImage object.
- * The function should probably use a cache because an instant response
- * is expected.
+ * It is called from a loader thread, so it must be reentrant
+ * (see setLoaderThreadCount()).
+ *
+ * Local files and loader functions are processed in the background
+ * by a small pool of loader threads. Loaded images are shrunk
+ * in the loader thread and then sent to cacheImage().
+ *
+ * A loader object (type LoaderObject, see ImageLoader) can be provided
+ * instead. It's given batches of paths along with the size of the
+ * thumbnails, in a loader thread, and delivers the images whenever
+ * they're ready, from any thread. This allows for loaders that keep
+ * state, load asynchronously or open a container once per batch.
+ * A function object (like a lambda) can be wrapped in one,
+ * see FunctionImageLoader.
  *
  * If External is used as source type, the parent module (or something else)
  * is responsible for loading the images.
@@ -26,11 +54,20 @@
  * The parent module is expected to catch this signal, load the image
  * and send it to the cacheImage() slot.
  * It can be loaded in the background to prevent the gui from freezing.
+ * Loaders which work in batches can use imagesRequested(),
+ * which carries all paths requested at once, and cacheImages().
+ * If the item is scrolled out of view before the image has been sent,
+ * imageRequestCancelled() is emitted and the request may be dropped.
  *
  * As long as any type other than Local is used,
  * image addresses could be remote urls.
  *
  * Loaded previews are cached.
+ * Thumbnails embedded in local image files (Exif) are used
+ * if they're big enough, the Exif orientation is applied.
+ *
+ * Previews of local files can also be cached on disk,
+ * so they don't have to be loaded again next time (see setDiskCache()).
  *
  * Loaded previews may be shrunk to save memory.
  *
@@ -48,13 +85,42 @@ ThumbnailBox::ThumbnailBox(QWidget *parent)
             : QFrame(parent),
               updating_thumbnails(false),
               _index(-1),
+              _list_provider(new ListProvider(this)),
+              _provider(_list_provider),
               _size(.3),
               _showdirs(false),
               _isclickable(true),
               _max_cache_pix_dimensions(200, 200),
+              _compressed_cache(0), //disabled
               _pixcache(500 * 1024), //500 KB
+              _pixmapcache(500 * 1024 / 4), //see setCacheLimit()
               _source_type(SourceType::Local),
-              _image_loader_function(0)
+              _image_loader_function(0),
+              _function_image_loader(0),
+              _embedded_thumbnails(true),
+              _loader(new Loader(this)),
+              _background_validation(false),
+              _validator(new Validator(this)),
+              _invalid_paths_scheduled(false),
+              _thumbs_created(0),
+              _thumbs_reused(0),
+              _render_mode(RenderMode::Widgets),
+              _viewport_first_index(0),
+              _viewport_columns(0),
+              _viewport_thumb_size(0),
+              _prefetch_rows(2),
+              _last_scroll_pos(0),
+              _scroll_direction(0),
+              _smooth_scrolling(false),
+              _scroll_only(false),
+              _viewport_offset(0),
+              _viewport_scroll_pos(0),
+              _wheel_delta(0),
+              _cache_dropped(0),
+              _compress_ticket(0),
+              _cache_removed(0),
+              _statistics_timer(new QTimer(this)),
+              _input_recorder(new InputRecorder)
 {
     //Copy original palette (may be changed, see setDarkBackground())
     _original_palette = palette();
@@ -73,6 +139,12 @@ ThumbnailBox::ThumbnailBox(QWidget *parent)
     thumbcontainer->setLayout(thumbcontainerlayout);
     hbox->addWidget(thumbcontainer);
 
+    //Thumbnail area, holds the (recycled) thumbnail widgets
+    thumbarea = new QWidget;
+    thumbarea->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
+    thumbcontainerlayout->insertWidget(0, thumbarea);
+    thumbarea->installEventFilter(this); //Painted mode
+
     //Scrollbar
     scrollbar = new QScrollBar(Qt::Vertical);
     scrollbar->setTracking(true);
@@ -80,7 +152,7 @@ ThumbnailBox::ThumbnailBox(QWidget *parent)
     scrollbar->setMaximum(0);
     connect(scrollbar,
             SIGNAL(valueChanged(int)),
-            SLOT(updateThumbnails(int)));
+            SLOT(scrollThumbnails(int)));
     hbox->addWidget(scrollbar);
 
     //Update view on resize
@@ -94,6 +166,40 @@ ThumbnailBox::ThumbnailBox(QWidget *parent)
             SIGNAL(rightClicked(int, const QPoint&)),
             SLOT(showMenu(int, const QPoint&)));
 
+    //Batches of images are passed between threads (ImageLoader)
+    qRegisterMetaType<QList<QImage> >("QList<QImage>");
+
+    //Images loaded in the background are cached like external ones
+    connect(_loader,
+            SIGNAL(imageLoaded(const QString&, const QImage&)),
+            SLOT(cacheImage(const QString&, const QImage&)));
+
+    //Invalid paths found in the background are removed from the list
+    connect(_validator,
+            SIGNAL(validated(const QStringList&, int, int)),
+            SLOT(collectInvalidPaths(const QStringList&, int, int)));
+    connect(_validator, SIGNAL(finished()), SLOT(finishValidation()));
+
+    //Statistics, emitted periodically if enabled (see setStatisticsInterval())
+    qRegisterMetaType<ThumbnailBox::Statistics>("ThumbnailBox::Statistics");
+    connect(_statistics_timer, SIGNAL(timeout()), SLOT(emitStatistics()));
+
+    //Images dropped from the cache are compressed by the loader threads
+    connect(_loader,
+            SIGNAL(compressed(const QString&, int, const QByteArray&)),
+            SLOT(storeCompressed(const QString&, int, const QByteArray&)),
+            Qt::QueuedConnection);
+
+}
+
+ThumbnailBox::~ThumbnailBox()
+{
+    //Don't compress the cached images just to throw them away
+    //They're dropped now, while this object is still intact
+    _compressed_cache.setMaxCost(0);
+    _pixcache.clear();
+
+    delete _input_recorder; //closes recording
 }
 
 int
@@ -141,6 +247,12 @@ ThumbnailBox::topRow()
 const
 {
     int scrollpos = scrollbar->value();
+    if (smoothScrollingEnabled())
+    {
+        //First row which is not (partially) hidden
+        int rowheight = rowHeight();
+        return (scrollpos + rowheight - 1) / rowheight;
+    }
     return scrollpos;
 }
 
@@ -151,6 +263,14 @@ const
     return topRow() + (rowCount() - 1);
 }
 
+int
+ThumbnailBox::rowHeight()
+const
+{
+    int padding = 5;
+    return thumbWidth() + padding;
+}
+
 double
 ThumbnailBox::thumbSize()
 const
@@ -187,6 +307,248 @@ const
     return thumb;
 }
 
+QRect
+ThumbnailBox::thumbRect(int index)
+const
+{
+    //Position of the thumbnail in the thumbnail area
+    //Based on the viewport of the last update
+    int padding = 5;
+    int size = _viewport_thumb_size;
+    int cols = _viewport_columns;
+    int relindex = index - _viewport_first_index;
+    if (cols < 1 || relindex < 0) return QRect();
+    int x = padding + (relindex % cols) * (size + padding);
+    int y = padding + (relindex / cols) * (size + padding) - _viewport_offset;
+    return QRect(x, y, size, size);
+}
+
+int
+ThumbnailBox::indexAt(const QPoint &pos)
+const
+{
+    //Calculate which thumbnail is at pos (in thumbnail area)
+    //Returns -1 if there's no thumbnail (or padding) at this position
+    int padding = 5;
+    int size = _viewport_thumb_size;
+    int cols = _viewport_columns;
+    if (cols < 1 || size < 1) return -1;
+    int x = pos.x() - padding;
+    int y = pos.y() - padding + _viewport_offset; //top row partially hidden
+    if (x < 0 || y < 0) return -1;
+    int col = x / (size + padding);
+    int row = y / (size + padding);
+    if (col >= cols) return -1;
+    if (x % (size + padding) >= size) return -1; //padding
+    if (y % (size + padding) >= size) return -1; //padding
+    int index = _viewport_first_index + row * cols + col;
+    if (!_visible_thumbnails_in_viewport.contains(index)) return -1;
+    return index;
+}
+
+void
+ThumbnailBox::paintThumbnails(const QRect &rect)
+{
+    //Draw all visible thumbnails on the thumbnail area (Painted mode)
+    //This is the equivalent of what the Thumb widgets look like,
+    //in a single paint event, without any widgets.
+    //Titles and previews have been prepared by bindPaintedThumb(),
+    //nothing is looked up (or loaded) here.
+    QPainter painter(thumbarea);
+    QPalette palette = thumbarea->palette();
+    QFontMetrics metrics = thumbarea->fontMetrics();
+    int line_width = 3;
+    int margin = line_width + 3;
+    int selected = index();
+
+    foreach (int index, visibleIndexes())
+    {
+        QRect thumb_rect = thumbRect(index);
+        if (!thumb_rect.intersects(rect)) continue;
+        PaintedThumb item = _painted_thumbs.value(index);
+
+        //Frame and background (if colored)
+        QBrush fill(item.color);
+        qDrawShadePanel(&painter, thumb_rect, palette, index == selected,
+                        line_width, item.color.isValid() ? &fill : 0);
+
+        //Title at the bottom
+        QRect inner = thumb_rect.adjusted(margin, margin, -margin, -margin);
+        QRect title_rect(inner);
+        title_rect.setTop(inner.bottom() - metrics.height() + 1);
+        painter.setPen(palette.color(QPalette::WindowText));
+        painter.drawText(title_rect, Qt::AlignLeft | Qt::AlignVCenter,
+                         item.title);
+
+        //Preview above the title, keeping its aspect ratio
+        QRect preview_rect(inner);
+        preview_rect.setBottom(title_rect.top() - margin);
+        QPixmap cached_pixmap = item.pixmap;
+        if (cached_pixmap.isNull() || !preview_rect.isValid()) continue;
+        QSize size = cached_pixmap.size();
+        size.scale(preview_rect.size(), Qt::KeepAspectRatio);
+        QRect target(QPoint(), size);
+        target.moveCenter(preview_rect.center());
+        painter.drawPixmap(target, cached_pixmap);
+    }
+}
+
+void
+ThumbnailBox::clickThumbnail(QMouseEvent *event)
+{
+    //Hit test, emit the same signals a Thumb would (Painted mode)
+    int index = indexAt(event->pos());
+    if (index == -1) return;
+    if (!itemsClickable()) return; //Thumb would be disabled
+
+    if (event->button() == Qt::LeftButton)
+    {
+        select(index);
+        emit clicked(index);
+        emit clicked(index, event->globalPos());
+    }
+    else if (event->button() == Qt::RightButton)
+    {
+        emit rightClicked(index);
+        emit rightClicked(index, event->globalPos());
+        emit contextMenuRequested(event->globalPos());
+    }
+    else if (event->button() == Qt::MiddleButton)
+    {
+        emit middleClicked(index);
+        emit middleClicked(index, event->globalPos());
+    }
+}
+
+ThumbnailBox::Thumb*
+ThumbnailBox::createThumb()
+{
+    //Create thumbnail widget in thumbnail area
+    //Signals are connected once, the index is updated when rebound
+    Thumb *thumb = new Thumb(-1, thumbarea);
+    thumb->setFrameStyle(QFrame::Panel | QFrame::Raised);
+    thumb->setLineWidth(3);
+
+    //Connect thumbnail signals
+    connect(thumb,
+            SIGNAL(clicked(int)),
+            SLOT(select(int)));
+    connect(thumb,
+            SIGNAL(clicked(int)),
+            SIGNAL(clicked(int)));
+    connect(thumb,
+            SIGNAL(clicked(int, const QPoint&)),
+            SIGNAL(clicked(int, const QPoint&)));
+    connect(thumb,
+            SIGNAL(rightClicked(int)),
+            SIGNAL(rightClicked(int)));
+    connect(thumb,
+            SIGNAL(rightClicked(int, const QPoint&)),
+            SIGNAL(rightClicked(int, const QPoint&)));
+    connect(thumb,
+            SIGNAL(contextMenuRequested(const QPoint&)),
+            SIGNAL(contextMenuRequested(const QPoint&)));
+    connect(thumb,
+            SIGNAL(middleClicked(int)),
+            SIGNAL(middleClicked(int)));
+    connect(thumb,
+            SIGNAL(middleClicked(int, const QPoint&)),
+            SIGNAL(middleClicked(int, const QPoint&)));
+
+    return thumb;
+}
+
+void
+ThumbnailBox::bindThumb(Thumb *thumb, int index)
+{
+    //Item path (put together once, kept by the thumb) and title
+    QString path = itemPath(index); //path, uri
+    QString title = itemTitle(index, path);
+
+    //Rebind thumbnail object to item
+    thumb->setIndex(index);
+    thumb->setPath(path);
+    thumb->setEnabled(itemsClickable());
+    thumb->setToolTip(title);
+    styleThumb(thumb, index);
+
+    //Add to list of visible thumbnails
+    _visible_thumbnails_in_viewport[index] = thumb;
+    _visible_paths.insert(path, index);
+
+    //Set title
+    thumb->setTitle(title);
+
+    //Load image (if available)
+    //A smaller image may be shown until the requested one is loaded
+    bool current;
+    QPixmap cached_pixmap = cachedPixmap(path, &current);
+    thumb->setPixmap(cached_pixmap); //from internal cache or empty
+    if (!current)
+    {
+        //Not cached, request it
+        //It will be drawn later
+        //Request is processed in background (unless External)
+        _statistics.cache_misses++;
+        requestImage(path);
+    }
+    else
+    {
+        _statistics.cache_hits++;
+    }
+}
+
+void
+ThumbnailBox::bindPaintedThumb(int index)
+{
+    //Prepare what paintThumbnails() draws for this item (Painted mode)
+    //Title, color and preview are looked up once, not in every paint event
+    PaintedThumb &item = _painted_thumbs[index];
+    item.path = itemPath(index); //path, uri
+    item.color = fileColor(item.path);
+
+    //Title, elided to the width it's drawn in (inside frame and margin)
+    int margin = 3 + 3; //line width, spacing, see paintThumbnails()
+    int width = thumbRect(index).width() - 2 * margin;
+    QString title = itemTitle(index, item.path);
+    item.title = thumbarea->fontMetrics().elidedText(title, Qt::ElideRight,
+                                                     width);
+
+    //Add to list of visible thumbnails
+    _visible_thumbnails_in_viewport[index] = 0;
+    _visible_paths.insert(item.path, index);
+
+    //Load image (if available)
+    //A smaller image may be shown until the requested one is loaded
+    bool current;
+    item.pixmap = cachedPixmap(item.path, &current);
+    if (!current)
+    {
+        _statistics.cache_misses++;
+        requestImage(item.path);
+    }
+    else
+    {
+        _statistics.cache_hits++;
+    }
+}
+
+void
+ThumbnailBox::styleThumb(Thumb *thumb, int index)
+{
+    //Frame (selection) and background (file color)
+    thumb->setFrameShadow(index == this->index() ?
+                          QFrame::Sunken : QFrame::Raised);
+    QColor clr_bg = fileColor(thumb->path());
+    thumb->setAutoFillBackground(clr_bg.isValid());
+    if (clr_bg.isValid())
+    {
+        QPalette palette = thumb->palette();
+        palette.setColor(QPalette::Window, clr_bg);
+        thumb->setPalette(palette);
+    }
+}
+
 QColor
 ThumbnailBox::fileColor(const QString &file)
 const
@@ -200,37 +562,197 @@ const
     return color;
 }
 
+QList<int>
+ThumbnailBox::previewLevels()
+const
+{
+    //Preview sizes (64, 128, 256, ...) up to the preview size limit
+    QList<int> levels;
+    int limit = qMax(_max_cache_pix_dimensions.width(),
+                     _max_cache_pix_dimensions.height());
+    for (int level = 64; level < limit; level *= 2)
+        levels << level;
+    levels << limit;
+    return levels;
+}
+
+int
+ThumbnailBox::thumbDeviceWidth()
+const
+{
+    //Thumbnail width in device pixels (HiDPI screens)
+    int width = thumbWidth();
+    #if QT_VERSION >= 0x050000
+    width *= devicePixelRatio();
+    #endif
+    return width;
+}
+
+int
+ThumbnailBox::previewLevel()
+const
+{
+    //Smallest preview size that fills a thumbnail (in device pixels)
+    int width = thumbDeviceWidth();
+    QList<int> levels = previewLevels();
+    foreach (int level, levels)
+    {
+        if (level >= width) return level;
+    }
+    return levels.last();
+}
+
+QString
+ThumbnailBox::cacheKey(const QString &file, int level)
+{
+    return QString("%1\n%2").arg(file).arg(level);
+}
+
+bool
+ThumbnailBox::isCached(const QString &file)
+const
+{
+    //Cached in the current size or a bigger one (without touching lru order)
+    int level = previewLevel();
+    foreach (int cached_level, previewLevels())
+    {
+        if (cached_level < level) continue;
+        QString key = cacheKey(file, cached_level);
+        if (_pixcache.contains(key) || _compressed_cache.contains(key))
+            return true;
+    }
+    return false;
+}
+
+void
+ThumbnailBox::insertCachedImage(const QString &key, const QImage &image)
+const
+{
+    //Put image in cache (then managed by cache)
+    //If it's dropped later, it's kept in the compressed cache (if enabled),
+    //see dropCachedImage()
+    CachedImage *cached_image = new CachedImage(key, image, this); //on heap!
+    int size = image.byteCount(); //size in bytes of shrunk image
+    _pixcache.insert(key, cached_image, size); //ownership goes to cache
+}
+
+void
+ThumbnailBox::dropCachedImage(const QString &key, const QImage &image)
+const
+{
+    //Called by a cached image that's dropped from the cache
+    //Dropped images are counted, see statistics()
+    _cache_dropped++;
+
+    //Keep compressed image (if enabled), unless it's compressed already
+    //It's compressed by a loader thread, not here (gui thread),
+    //see storeCompressed()
+    if (_compressed_cache.maxCost() <= 0) return;
+    if (_compressed_cache.contains(key) || _compressing.contains(key)) return;
+    int ticket = ++_compress_ticket;
+    _compressing.insert(key, ticket);
+    _loader->compress(key, ticket, image);
+}
+
 QImage
-ThumbnailBox::cachedImage(const QString &file)
+ThumbnailBox::cachedImage(const QString &file, int level)
 const
 {
-    //Get cached image or create empty image if not cached
+    //Get cached image of this size or create empty image if not cached
     //Cached image (heap) is (shallow) copied locally first (stack)
     //Cached image could be deleted at any point (managed by cache)
     QImage image;
-    if (_pixcache.contains(file))
-        image = QImage(*_pixcache.object(file)); //local shallow copy
+    QString key = cacheKey(file, level);
+    if (_pixcache.contains(key))
+        return _pixcache.object(key)->image(); //local shallow copy
+
+    //Decompress image that has been dropped from the cache before
+    //It's put back in the cache, it stays in the compressed cache as well,
+    //so it won't be compressed again when it's dropped next time
+    if (_compressed_cache.contains(key))
+    {
+        image = CachedImage::decompress(*_compressed_cache.object(key));
+        if (image.isNull()) return image;
+        insertCachedImage(key, image);
+        _statistics.compressed_hits++;
+    }
+
+    return image;
+}
+
+QImage
+ThumbnailBox::cachedImage(const QString &file)
+const
+{
+    //Get cached image in the size of the thumbnails
+    int level = previewLevel();
+    QImage image = cachedImage(file, level);
+    if (!image.isNull()) return image;
+
+    //Shrink a bigger cached image (after zooming out),
+    //this is much faster than loading it again
+    foreach (int bigger_level, previewLevels())
+    {
+        if (bigger_level <= level) continue;
+        QImage bigger_image = cachedImage(file, bigger_level);
+        if (bigger_image.isNull()) continue;
+        TraceSpan span(tracer(), "shrinkImage", file);
+        image = shrinkImage(bigger_image, QSize(level, level));
+        insertCachedImage(cacheKey(file, level), image);
+        _statistics.derived_hits++;
+        break;
+    }
 
     return image;
 }
 
 QPixmap
-ThumbnailBox::cachedPixmap(const QString &file)
+ThumbnailBox::cachedPixmap(const QString &file, bool *current)
 const
 {
     //Get cached image
+    //If it's only cached in a smaller size (after zooming in),
+    //that one is shown until the requested one has been loaded
+    //current is set if it's cached in the size of the thumbnails
     QImage image = cachedImage(file);
+    if (current) *current = !image.isNull();
+    QList<int> levels = previewLevels();
+    int level = previewLevel();
+    for (int i = levels.size() - 1; i >= 0 && image.isNull(); i--)
+    {
+        if (levels.at(i) < level) image = cachedImage(file, levels.at(i));
+    }
+    if (image.isNull()) return QPixmap(); //not cached
+
+    //Get converted pixmap, if this image has been drawn before
+    //The key identifies this image, an updated image has another key,
+    //so the outdated pixmap is never used (and dropped eventually)
+    QString key = QString("%1\n%2").arg(file).arg(image.cacheKey());
+    if (_pixmapcache.contains(key))
+        return QPixmap(*_pixmapcache.object(key)); //local shallow copy
+
+    //Convert to QPixmap (display format), keep it for next time
+    TraceSpan span(tracer(), "convertPixmap", file);
+    QPixmap *pixmap = new QPixmap; //on heap!
+    pixmap->convertFromImage(image);
+    QPixmap converted_pixmap(*pixmap);
+    int size = pixmap->width() * pixmap->height() * pixmap->depth() / 8;
+    _pixmapcache.insert(key, pixmap, size); //ownership goes to cache
+
+    return converted_pixmap;
+}
 
-    //Convert to QPixmap (if found, empty otherwise)
-    QPixmap pixmap;
-    if (!image.isNull())
-        pixmap.convertFromImage(image);
-
-    return pixmap;
+ThumbnailBox::Tracer*
+ThumbnailBox::tracer()
+const
+{
+    //Recorded spans are only created if tracing is enabled
+    Tracer *tracer = _loader->tracer();
+    return tracer->isEnabled() ? tracer : 0;
 }
 
 void
-ThumbnailBox::requestImage(const QString &path)
+ThumbnailBox::requestImage(const QString &path, int priority)
 {
     //Request image (identified by path)
     //Response -> compress -> cacheImage() -> thumbnail drawn
@@ -239,39 +761,182 @@ ThumbnailBox::requestImage(const QString &path)
     //This might be due to an undersized cache or oversized preview limit.
     //At the time of writing, the default preview limit is 200x200 px
     //and the cache limit is 500 KB, tested images are 150-200 KB in size.
+    //Priority 0 means visible, higher values are loaded later (prefetch).
+    //Requests which are not repeated in the next update are cancelled.
+    //There's at most one request per image in flight, repeated requests
+    //are merged, so the image is delivered to cacheImage() once.
+    //Images that could not be loaded are not requested again.
+
+    Tracer *tracer = this->tracer();
+    TraceSpan span(tracer, "requestImage", path, tracer ? indexOf(path) : -1);
+    _wanted_paths[path] = priority;
+    if (_requested_paths.contains(path))
+    {
+        _statistics.requests_deduplicated++;
+        return; //in flight
+    }
+    if (_failed_paths.contains(path)) return; //don't try again
+    int level = previewLevel(); //size of the thumbnails
+    _requested_paths.insert(path, level);
+    _statistics.requests_issued++;
+
+    Loader::Request request;
+    request.path = path;
+    request.priority = priority;
+    request.type = sourceType();
+    request.function = _image_loader_function;
+    request.max_size = QSize(level, level);
+    request.disk_cache = _loader->diskCache();
+    request.image_loader = _image_loader;
+    request.tracer = tracer;
+    request.min_size = thumbDeviceWidth();
+    request.embedded_thumbnails = embeddedThumbnailsEnabled();
 
     QImage image;
     switch (sourceType())
     {
         case SourceType::Local:
         //Load image directly from file (path points to file)
-        //TODO run in background, non-blocking!
-        image.load(path);
-        cacheImage(path, image);
-        break;
-
         case SourceType::LoaderFunction:
         //Call external function which returns QImage
-        //Loader should have a cache or else this will block the gui
-        if (_image_loader_function)
-            image = _image_loader_function(path);
-        cacheImage(path, image);
+        //Both are loaded (and shrunk) by a loader thread,
+        //the loader will send the image to cacheImage()
+        //If the loader is synchronous, this will block the gui
+        if (_loader->threadCount())
+        {
+            _loader->enqueue(request);
+        }
+        else
+        {
+            Loader::Timing timing;
+            qint64 start = tracer ? tracer->now() : 0;
+            image = Loader::loadImage(request, &timing);
+            _loader->addTiming(timing);
+            Loader::trace(request, start, timing);
+            cacheImage(path, image);
+        }
+        break;
+
+        case SourceType::LoaderObject:
+        //Pass batch of requests to loader object, in a loader thread
+        //It will send the images to cacheImages(), now or later
+        //If the loader is synchronous, it's called right here
+        if (!_image_loader)
+        {
+            cacheImage(path, image); //no loader, failed
+        }
+        else if (_loader->threadCount())
+        {
+            _loader->enqueue(request);
+        }
+        else
+        {
+            _image_loader->load(QStringList() << path, request.max_size);
+        }
         break;
 
         case SourceType::External:
         //Request image from external loader (path is uri)
         //Response will be sent to cacheImage() by parent module
         //This is async by design
+        //Requests are also collected and sent in batches (imagesRequested()),
+        //once control returns to the event loop
         emit imageRequested(path);
+        if (_requested_batch.isEmpty())
+            QTimer::singleShot(0, this, SLOT(flushImageRequests()));
+        _requested_batch << path;
         break;
 
     }
 
 }
 
+void
+ThumbnailBox::cancelRequests()
+{
+    //Cancel requests for images that are not wanted anymore
+    //(not visible and not prefetched in the last update)
+    //Work should be spent on what the user is looking at now
+
+    //Drop queued loader requests
+    //Running ones can't be stopped, they're still in flight
+    foreach (const QString &path, _loader->retain(_wanted_paths))
+    {
+        _requested_paths.remove(path);
+        _statistics.requests_cancelled++;
+    }
+
+    //Notify external loader
+    if (sourceType() != SourceType::External) return;
+    foreach (const QString &path, _requested_paths.keys())
+    {
+        if (_wanted_paths.contains(path)) continue;
+        _requested_paths.remove(path);
+        _statistics.requests_cancelled++;
+        emit imageRequestCancelled(path);
+    }
+}
+
+void
+ThumbnailBox::prefetchImages(int top_row, int bottom_row, int cols)
+{
+    //Request images of rows above and below the viewport,
+    //after the visible ones and with a lower priority
+    int prefetch_rows = prefetchRows();
+    if (!prefetch_rows || cols < 1) return;
+    if (sourceType() != SourceType::External && !_loader->threadCount())
+        return; //synchronous loader, would block the gui
+
+    //Prefetch only as many as fit in the cache next to the visible ones
+    //Otherwise, prefetched images would evict the visible ones
+    int level = qMax(previewLevel(), 1);
+    qint64 preview_bytes = (qint64)4 * level * level;
+    qint64 visible_bytes =
+        preview_bytes * _visible_thumbnails_in_viewport.size();
+    qint64 budget = _pixcache.maxCost() - visible_bytes;
+    int max_items = budget > 0 ? budget / preview_bytes : 0;
+
+    //More rows in the direction of the last scroll, fewer behind
+    int rows_below = prefetch_rows;
+    int rows_above = prefetch_rows;
+    if (_scroll_direction > 0) rows_above /= 2;
+    else if (_scroll_direction < 0) rows_below /= 2;
+
+    //Closest rows first, the priority is the distance from the viewport
+    int count = this->count();
+    for (int distance = 1; distance <= prefetch_rows; distance++)
+    {
+        QList<int> rows;
+        if (distance <= rows_below) rows << bottom_row + distance;
+        if (distance <= rows_above)
+        {
+            if (_scroll_direction < 0) rows.prepend(top_row - distance);
+            else rows << top_row - distance;
+        }
+
+        foreach (int row, rows)
+        {
+            for (int col = 0; col < cols; col++)
+            {
+                int index = row * cols + col;
+                if (index < 0 || index >= count) break;
+                if (max_items-- <= 0) return; //cache budget exhausted
+                QString path = itemPath(index); //path, uri
+                if (!isCached(path))
+                    requestImage(path, distance);
+            }
+        }
+    }
+}
+
 void
 ThumbnailBox::resizeEvent(QResizeEvent *event)
 {
+    if (_input_recorder->isRecording())
+        _input_recorder->record(QString("resize %1 %2")
+                                .arg(event->size().width())
+                                .arg(event->size().height()));
+
     if (event->oldSize().isValid())
         emit resized();
 
@@ -281,17 +946,55 @@ ThumbnailBox::resizeEvent(QResizeEvent *event)
 void
 ThumbnailBox::wheelEvent(QWheelEvent *event)
 {
-    int degrees = event->delta() / 8;
-    int steps = degrees / 15;
-
     if (event->orientation() != Qt::Vertical) return;
     if (!scrollbar->isEnabled()) return;
 
-    scrollbar->setValue(scrollbar->value() - steps);
+    //One step (15 degrees, delta 120) scrolls one row
+    //Smaller deltas (touchpads, hi-res wheels) are accumulated,
+    //they used to be dropped
+    int steps = 0;
+    bool smooth = smoothScrollingEnabled();
+    #if QT_VERSION >= 0x050000
+    if (smooth && !event->pixelDelta().isNull())
+    {
+        //Touchpad reports pixels, scroll exactly that far
+        steps = event->pixelDelta().y();
+    }
+    else
+    #endif
+    {
+        _wheel_delta += event->delta() * (smooth ? rowHeight() : 1);
+        steps = _wheel_delta / 120;
+        _wheel_delta -= steps * 120; //remainder, added to the next event
+    }
+
+    if (steps) scrollbar->setValue(scrollbar->value() - steps);
 
     event->accept();
 }
 
+bool
+ThumbnailBox::eventFilter(QObject *object, QEvent *event)
+{
+    //In Painted mode, the thumbnail area is drawn and clicked here
+    if (object == thumbarea && renderMode() == RenderMode::Painted)
+    {
+        if (event->type() == QEvent::Paint)
+        {
+            paintThumbnails(static_cast<QPaintEvent*>(event)->rect());
+            return true;
+        }
+        else if (event->type() == QEvent::MouseButtonPress)
+        {
+            clickThumbnail(static_cast<QMouseEvent*>(event));
+            event->accept();
+            return true;
+        }
+    }
+
+    return QFrame::eventFilter(object, event);
+}
+
 void
 ThumbnailBox::showMenu(int index, const QPoint &pos)
 {
@@ -300,7 +1003,7 @@ ThumbnailBox::showMenu(int index, const QPoint &pos)
     QString item = itemPath(index);
     if (item.isEmpty()) return;
 
-    QString title = itemTitle(index);
+    QString title = itemTitle(index, item);
 
     QMenu menu;
     QAction *action = new QAction(title, &menu);
@@ -321,26 +1024,64 @@ void
 ThumbnailBox::updateThumbnail(int index)
 {
     //Check if thumbnail visible
-    if (!visibleIndexes().contains(index))
+    if (!_visible_thumbnails_in_viewport.contains(index))
         return; //it's not
 
     //Get thumbnail
     QPointer<Thumb> thumb = thumbAtIndex(index);
+    if (!thumb)
+    {
+        //Painted mode, convert preview, redraw this thumbnail only
+        PaintedThumb &item = _painted_thumbs[index];
+        item.pixmap = cachedPixmap(item.path);
+        thumbarea->update(thumbRect(index));
+        return;
+    }
 
     //Get preview
-    QString path = itemPath(index); //path, uri
-    QPixmap cached_pixmap = cachedPixmap(path);
+    QPixmap cached_pixmap = cachedPixmap(thumb->path());
 
     //Redraw thumbnail
     thumb->setPixmap(cached_pixmap);
 
 }
 
+void
+ThumbnailBox::restyleThumbnail(int index)
+{
+    //Check if thumbnail visible
+    if (!_visible_thumbnails_in_viewport.contains(index))
+        return; //it's not
+
+    //Get thumbnail
+    QPointer<Thumb> thumb = thumbAtIndex(index);
+    if (!thumb)
+    {
+        //Painted mode, update color, redraw this thumbnail only
+        PaintedThumb &item = _painted_thumbs[index];
+        item.color = fileColor(item.path);
+        thumbarea->update(thumbRect(index));
+        return;
+    }
+
+    //Update frame and background, the preview is unchanged
+    styleThumb(thumb, index);
+}
+
+void
+ThumbnailBox::restyleThumbnail(const QString &file)
+{
+    foreach (int index, _visible_paths.values(file))
+        restyleThumbnail(index);
+}
+
 void
 ThumbnailBox::updateThumbnail(const QString &file)
 {
-    int index = indexOf(file);
-    updateThumbnail(index);
+    //Only visible thumbnails need to be redrawn
+    //The same path may be listed more than once
+    foreach (int index, _visible_paths.values(file))
+        updateThumbnail(index);
 }
 
 /*!
@@ -354,6 +1095,17 @@ const
     return _source_type;
 }
 
+/*!
+ * Returns how thumbnails are drawn.
+ * By default (Widgets), every visible thumbnail is a widget.
+ */
+ThumbnailBox::RenderMode
+ThumbnailBox::renderMode()
+const
+{
+    return _render_mode;
+}
+
 /*!
  * Shrinks a copy of original_image if it's bigger
  * than the preview size limit.
@@ -363,35 +1115,326 @@ ThumbnailBox::shrinkImage(const QImage &original_image)
 const
 {
     //Configured maximum size (dimensions)
-    QSize max_size(_max_cache_pix_dimensions);
+    return shrinkImage(original_image, _max_cache_pix_dimensions);
+}
 
-    //Original size
-    QSize original_size = original_image.size();
+//Downscaling helpers, see downscaleImage()
+//Area filter, every destination pixel is the weighted average
+//of the source pixels it covers, in two passes (rows, then columns).
+//Weights of a destination pixel add up to 256, so a row sum fits in 16 bits
+//and a sum of rows fits in 32 bits (255 * 256 * 256).
 
-    //Resize image (if necessary)
-    QImage image(original_image); //shallow copy
-    if (max_size.isValid())
+static void
+scaleWeights(int src, int dst, QVector<int> &first, QVector<int> &count,
+             QVector<int> &offset, QVector<quint16> &weights)
+{
+    //Destination pixel i covers source pixels [i * src, (i + 1) * src) / dst
+    //Weights are rounded cumulatively, so they add up to 256 exactly
+    first.resize(dst);
+    count.resize(dst);
+    offset.resize(dst);
+    weights.clear();
+    weights.reserve(dst * (src / dst + 2));
+    for (int i = 0; i < dst; i++)
     {
-        if (original_size.width() > max_size.width() ||
-            original_size.height() > max_size.height())
+        qint64 start = (qint64)i * src;
+        qint64 end = start + src;
+        int first_pixel = start / dst;
+        int last_pixel = (end - 1) / dst;
+        first[i] = first_pixel;
+        count[i] = last_pixel - first_pixel + 1;
+        offset[i] = weights.size();
+
+        qint64 covered = 0;
+        int previous = 0;
+        for (int j = first_pixel; j <= last_pixel; j++)
         {
-            //Image is bigger, shrink it
-            image = image.scaled(max_size, Qt::KeepAspectRatio);
+            qint64 overlap = qMin(end, (qint64)(j + 1) * dst) -
+                             qMax(start, (qint64)j * dst);
+            covered += overlap;
+            int cumulative = (covered * 256 + src / 2) / src;
+            weights << (quint16)(cumulative - previous);
+            previous = cumulative;
         }
     }
-
-    return image;
 }
 
-/*!
- * Returns the current list of file addresses.
- */
-QStringList
-ThumbnailBox::list()
-const
+static void
+scaleRow(const uchar *src, quint16 *out, int channels, int width,
+         const int *first, const int *count, const int *offset,
+         const quint16 *weights)
 {
-    return _list;
-}
+    //Horizontal pass, one source row to width pixels (16 bit per channel)
+    #ifdef THUMBNAILBOX_SSE2
+    if (channels == 4)
+    {
+        //All four channels of a pixel at once
+        const quint32 *pixels = reinterpret_cast<const quint32*>(src);
+        __m128i zero = _mm_setzero_si128();
+        for (int i = 0; i < width; i++)
+        {
+            const quint32 *pixel = pixels + first[i];
+            const quint16 *weight = weights + offset[i];
+            __m128i sum = zero;
+            for (int j = 0; j < count[i]; j++)
+            {
+                __m128i value = _mm_cvtsi32_si128(pixel[j]);
+                value = _mm_unpacklo_epi8(value, zero);
+                value = _mm_mullo_epi16(value, _mm_set1_epi16(weight[j]));
+                sum = _mm_add_epi16(sum, value);
+            }
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 4 * i), sum);
+        }
+        return;
+    }
+    #endif
+
+    for (int i = 0; i < width; i++)
+    {
+        const uchar *pixel = src + first[i] * channels;
+        const quint16 *weight = weights + offset[i];
+        for (int c = 0; c < channels; c++)
+        {
+            int sum = 0;
+            for (int j = 0; j < count[i]; j++)
+                sum += pixel[j * channels + c] * weight[j];
+            out[i * channels + c] = sum;
+        }
+    }
+}
+
+#ifdef THUMBNAILBOX_AVX2
+__attribute__((target("avx2")))
+static void
+accumulateRowAvx2(quint32 *sum, const quint16 *row, int size, int weight)
+{
+    //Eight values at once
+    __m256i factor = _mm256_set1_epi32(weight);
+    int i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        __m128i values =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        __m256i product =
+            _mm256_mullo_epi32(_mm256_cvtepu16_epi32(values), factor);
+        __m256i *target = reinterpret_cast<__m256i*>(sum + i);
+        _mm256_storeu_si256(target,
+            _mm256_add_epi32(_mm256_loadu_si256(target), product));
+    }
+    for (; i < size; i++)
+        sum[i] += row[i] * weight;
+}
+
+static bool
+hasAvx2()
+{
+    static bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+#endif
+
+static void
+accumulateRow(quint32 *sum, const quint16 *row, int size, int weight)
+{
+    //Vertical pass, add weighted row (16 bit) to destination row (32 bit)
+    #ifdef THUMBNAILBOX_AVX2
+    if (hasAvx2())
+    {
+        accumulateRowAvx2(sum, row, size, weight);
+        return;
+    }
+    #endif
+
+    int i = 0;
+    #ifdef THUMBNAILBOX_SSE2
+    //Eight values at once, 16 x 16 bit products are put together from
+    //their low and high halves
+    __m128i factor = _mm_set1_epi16(weight);
+    for (; i + 8 <= size; i += 8)
+    {
+        __m128i values =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        __m128i low = _mm_mullo_epi16(values, factor);
+        __m128i high = _mm_mulhi_epu16(values, factor);
+        __m128i *target = reinterpret_cast<__m128i*>(sum + i);
+        __m128i first = _mm_unpacklo_epi16(low, high);
+        __m128i second = _mm_unpackhi_epi16(low, high);
+        _mm_storeu_si128(target, _mm_add_epi32(_mm_loadu_si128(target), first));
+        _mm_storeu_si128(target + 1,
+                         _mm_add_epi32(_mm_loadu_si128(target + 1), second));
+    }
+    #endif
+    for (; i < size; i++)
+        sum[i] += row[i] * weight;
+}
+
+static void
+storeRow(uchar *dst, const quint32 *sum, int size)
+{
+    //Destination row, divided by 256 * 256 (rounded)
+    int i = 0;
+    #ifdef THUMBNAILBOX_SSE2
+    //Sixteen values at once
+    __m128i half = _mm_set1_epi32(1 << 15);
+    for (; i + 16 <= size; i += 16)
+    {
+        const __m128i *source = reinterpret_cast<const __m128i*>(sum + i);
+        __m128i values[4];
+        for (int j = 0; j < 4; j++)
+        {
+            values[j] = _mm_add_epi32(_mm_loadu_si128(source + j), half);
+            values[j] = _mm_srli_epi32(values[j], 16);
+        }
+        __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(values[0], values[1]),
+                                         _mm_packs_epi32(values[2], values[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), bytes);
+    }
+    #endif
+    for (; i < size; i++)
+        dst[i] = (sum[i] + (1 << 15)) >> 16;
+}
+
+/*!
+ * Shrinks a copy of original_image if it's bigger than max_size.
+ * This does not depend on any ThumbnailBox object,
+ * so it may be called from a loader thread.
+ */
+QImage
+ThumbnailBox::shrinkImage(const QImage &original_image, const QSize &max_size)
+{
+    //Original size
+    QSize original_size = original_image.size();
+
+    //Resize image (if necessary)
+    QImage image(original_image); //shallow copy
+    if (max_size.isValid())
+    {
+        if (original_size.width() > max_size.width() ||
+            original_size.height() > max_size.height())
+        {
+            //Image is bigger, shrink it
+            QSize size = original_size.scaled(max_size, Qt::KeepAspectRatio);
+            image = downscaleImage(image, size.expandedTo(QSize(1, 1)));
+        }
+    }
+
+    return image;
+}
+
+/*!
+ * Returns a copy of original_image scaled down to size (ignoring the
+ * aspect ratio), using an area filter: every pixel is the average
+ * of the pixels it covers. This looks as smooth as
+ * Qt::SmoothTransformation and is faster than it
+ * for large reductions (SSE2/AVX2 on x86).
+ * RGB32, ARGB32_Premultiplied and RGB888 images are scaled as they are,
+ * others are converted first (ARGB32 to ARGB32_Premultiplied).
+ * This may be called from a loader thread.
+ */
+QImage
+ThumbnailBox::downscaleImage(const QImage &original_image, const QSize &size)
+{
+    //Bigger, left to QImage
+    if (original_image.isNull() || size.isEmpty()) return QImage();
+    if (size.width() > original_image.width() ||
+        size.height() > original_image.height())
+    {
+        return original_image.scaled(size, Qt::IgnoreAspectRatio,
+                                     Qt::SmoothTransformation);
+    }
+
+    //Formats with 4 or 3 bytes per pixel
+    //Colors must be premultiplied to be averaged
+    QImage image;
+    switch (original_image.format())
+    {
+        case QImage::Format_RGB32:
+        case QImage::Format_ARGB32_Premultiplied:
+        case QImage::Format_RGB888:
+        image = original_image;
+        break;
+
+        default:
+        image = original_image.convertToFormat(
+            original_image.hasAlphaChannel() ?
+            QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+        break;
+    }
+    int channels = image.format() == QImage::Format_RGB888 ? 3 : 4;
+    int width = size.width();
+    int height = size.height();
+    QImage scaled_image(size, image.format());
+    if (scaled_image.isNull()) return scaled_image; //out of memory
+
+    //Source pixels and weights of every column and row
+    QVector<int> col_first, col_count, col_offset;
+    QVector<int> row_first, row_count, row_offset;
+    QVector<quint16> col_weights, row_weights;
+    scaleWeights(image.width(), width,
+                 col_first, col_count, col_offset, col_weights);
+    scaleWeights(image.height(), height,
+                 row_first, row_count, row_offset, row_weights);
+
+    //Every destination row is the weighted sum of its scaled source rows
+    //A source row on the edge belongs to two destination rows,
+    //the last scaled row is kept so it's only scaled once
+    int size_row = width * channels;
+    QVector<quint16> scaled_row(size_row);
+    QVector<quint32> sum(size_row);
+    int scaled_row_index = -1;
+    for (int y = 0; y < height; y++)
+    {
+        sum.fill(0);
+        for (int i = 0; i < row_count.at(y); i++)
+        {
+            int source_row = row_first.at(y) + i;
+            if (source_row != scaled_row_index)
+            {
+                scaleRow(image.constScanLine(source_row), scaled_row.data(),
+                         channels, width, col_first.constData(),
+                         col_count.constData(), col_offset.constData(),
+                         col_weights.constData());
+                scaled_row_index = source_row;
+            }
+            accumulateRow(sum.data(), scaled_row.constData(), size_row,
+                          row_weights.at(row_offset.at(y) + i));
+        }
+        storeRow(scaled_image.scanLine(y), sum.constData(), size_row);
+    }
+
+    return scaled_image;
+}
+
+/*!
+ * Returns the current list of file addresses.
+ * If a custom provider is used (see setItemProvider()),
+ * this reads the addresses of all of its items.
+ */
+QStringList
+ThumbnailBox::list()
+const
+{
+    ItemProvider *provider = itemProvider();
+    if (provider == _list_provider) return _list_provider->list();
+    QStringList list;
+    int count = provider->count();
+    list.reserve(count);
+    for (int i = 0; i < count; i++)
+        list << provider->path(i);
+    return list;
+}
+
+/*!
+ * Returns the provider of the items, which is the list given to setList()
+ * unless a custom provider is used (see setItemProvider()).
+ */
+ThumbnailBox::ItemProvider*
+ThumbnailBox::itemProvider()
+const
+{
+    if (_provider) return _provider;
+    return _list_provider; //custom provider deleted
+}
 
 /*!
  * Returns the total number of thumbnails.
@@ -400,7 +1443,7 @@ int
 ThumbnailBox::count()
 const
 {
-    return list().size();
+    return itemProvider()->count();
 }
 
 /*!
@@ -421,7 +1464,7 @@ int
 ThumbnailBox::indexOf(const QString &file)
 const
 {
-    return list().indexOf(file);
+    return itemProvider()->indexOf(file);
 }
 
 /*!
@@ -458,7 +1501,7 @@ const
 {
     QString path;
     if (index == -1) index = this->index();
-    if (isValidIndex(index)) path = list().at(index);
+    if (isValidIndex(index)) path = itemProvider()->path(index);
     return path;
 }
 
@@ -466,12 +1509,29 @@ const
  * Returns the title that is shown on the thumbnail.
  * By default, this is the file name, which is extracted from the address.
  * It will be the full address if the file name can't be extracted.
+ * A custom provider may define the titles, see ItemProvider.
  */
 QString
 ThumbnailBox::itemTitle(int index)
 const
 {
-    QString path = itemPath(index); //might not exist or look weird
+    if (index == -1) index = this->index();
+    return itemTitle(index, itemPath(index));
+}
+
+QString
+ThumbnailBox::itemTitle(int index, const QString &path)
+const
+{
+    //Title of the item at index, whose path has been looked up already
+    //(putting it together again would allocate another string)
+    if (isValidIndex(index))
+    {
+        QString title = itemProvider()->title(index);
+        if (!title.isEmpty()) return title;
+    }
+
+    //Path might not exist or look weird
     QString title = QFileInfo(path).baseName();
     if (title.isEmpty())
         title = path; //use full address rather than empty title
@@ -530,6 +1590,63 @@ const
     return _actions.size();
 }
 
+/*!
+ * Returns the number of rows above and below the viewport
+ * whose images are loaded in advance.
+ */
+int
+ThumbnailBox::prefetchRows()
+const
+{
+    return _prefetch_rows;
+}
+
+/*!
+ * Returns the number of thumbnail widgets that were created
+ * during the last update.
+ * Thumbnails are recycled, so this should be 0 while scrolling.
+ */
+int
+ThumbnailBox::thumbsCreated()
+const
+{
+    return _thumbs_created;
+}
+
+/*!
+ * Returns the number of thumbnail widgets that were reused
+ * (rebound to another item) during the last update.
+ */
+int
+ThumbnailBox::thumbsReused()
+const
+{
+    return _thumbs_reused;
+}
+
+/*!
+ * Returns the number of loader threads.
+ * If this is 0, images are loaded synchronously (blocking the gui).
+ */
+int
+ThumbnailBox::loaderThreadCount()
+const
+{
+    return _loader->threadCount();
+}
+
+/*!
+ * Returns the number of images that have been requested
+ * but not received yet, i.e. that are being loaded in the background
+ * (queued or in progress) or requested from the external loader.
+ */
+int
+ThumbnailBox::pendingImageCount()
+const
+{
+    return _requested_paths.size();
+}
+
 /*!
  * Sets the frame style.
  */
@@ -568,10 +1685,183 @@ ThumbnailBox::setDarkBackground(bool dark)
     }
 }
 
+/*!
+ * Returns true if thumbnails embedded in image files (Exif)
+ * are used, if they're big enough.
+ */
+bool
+ThumbnailBox::embeddedThumbnailsEnabled()
+const
+{
+    return _embedded_thumbnails;
+}
+
+/*!
+ * Returns the directory of the disk cache.
+ * This is empty if the disk cache is not used (default).
+ */
+QString
+ThumbnailBox::diskCacheDirectory()
+const
+{
+    return _loader->diskCache()->directory();
+}
+
+/*!
+ * Returns true if the viewport is scrolled by pixels rather than rows,
+ * see setSmoothScrollingEnabled().
+ */
+bool
+ThumbnailBox::smoothScrollingEnabled()
+const
+{
+    return _smooth_scrolling;
+}
+
+/*!
+ * Returns true if local paths are checked in the background,
+ * see setBackgroundValidationEnabled().
+ */
+bool
+ThumbnailBox::backgroundValidationEnabled()
+const
+{
+    return _background_validation;
+}
+
+/*!
+ * Returns true while the paths of the current list are being checked
+ * in the background.
+ */
+bool
+ThumbnailBox::isValidating()
+const
+{
+    return _validator->isRunning();
+}
+
+/*!
+ * Returns the statistics collected since the widget was created
+ * (or since resetStatistics()), along with the current cache usage.
+ *
+ * Cache hits and misses count the lookups of visible thumbnails
+ * when they're bound to an item. Compressed hits are images restored
+ * from the compressed cache, derived hits are images shrunk
+ * from a bigger cached one. Evictions are images dropped
+ * from the cache to make room, not the ones replaced or cleared.
+ *
+ * Decode and shrink times are measured by the loader threads
+ * (or in the gui thread if the loader is synchronous or External),
+ * update times are those of updateThumbnails().
+ * Collecting them costs a few timer reads per image.
+ */
+ThumbnailBox::Statistics
+ThumbnailBox::statistics()
+const
+{
+    Statistics statistics = _statistics;
+    statistics.cache_evictions = _cache_dropped - _cache_removed;
+    statistics.cache_items = _pixcache.count();
+    statistics.cache_bytes = _pixcache.totalCost();
+    statistics.compressed_bytes = _compressed_cache.totalCost();
+    statistics.pixmap_bytes = _pixmapcache.totalCost();
+
+    //Times measured by loader threads
+    Histogram decode_time;
+    Histogram shrink_time;
+    _loader->timing(decode_time, shrink_time);
+    statistics.decode_time.merge(decode_time);
+    statistics.shrink_time.merge(shrink_time);
+
+    return statistics;
+}
+
+/*!
+ * Returns the interval (in ms) in which statisticsUpdated() is emitted,
+ * 0 if it's disabled.
+ */
+int
+ThumbnailBox::statisticsInterval()
+const
+{
+    return _statistics_timer->isActive() ? _statistics_timer->interval() : 0;
+}
+
+/*!
+ * Returns true if spans are being recorded, see setTraceEnabled().
+ */
+bool
+ThumbnailBox::isTraceEnabled()
+const
+{
+    return _loader->tracer()->isEnabled();
+}
+
+/*!
+ * Writes the recorded spans to the given file, in the Chrome trace
+ * (JSON) format, which can be opened in Perfetto or chrome://tracing.
+ * Returns false if the file could not be written.
+ */
+bool
+ThumbnailBox::writeTrace(const QString &file)
+const
+{
+    return _loader->tracer()->write(file);
+}
+
+/*!
+ * Starts recording the input of this session to the given file
+ * (which is overwritten): list sizes, widget sizes, scrollbar values,
+ * selected items, thumbnail sizes and mode changes.
+ * The replay tool (see bench) drives a ThumbnailBox through the same
+ * sequence to measure frame times, with synthetic or real images.
+ * The current state is recorded first.
+ *
+ * Each line is one event, preceded by the time in ms since the start,
+ * e.g. "1520 scroll 42". Paths are not recorded.
+ * Paths removed by the background validation are not recorded either.
+ * Returns false if the file could not be opened.
+ */
+bool
+ThumbnailBox::startInputRecording(const QString &file)
+{
+    if (!_input_recorder->start(file)) return false;
+
+    //Current state
+    _input_recorder->record(QString("list %1").arg(count()));
+    _input_recorder->record(QString("mode %1").arg(
+                            renderMode() == RenderMode::Painted ?
+                            "painted" : "widgets"));
+    _input_recorder->record(QString("smooth %1")
+                            .arg(smoothScrollingEnabled() ? 1 : 0));
+    _input_recorder->record(QString("size %1").arg(_size));
+    _input_recorder->record(QString("resize %1 %2")
+                            .arg(width()).arg(height()));
+    _input_recorder->record(QString("scroll %1").arg(scrollbar->value()));
+    _input_recorder->record(QString("select %1").arg(index()));
+    return true;
+}
+
+/*!
+ * Returns true while the input is being recorded.
+ */
+bool
+ThumbnailBox::isRecordingInput()
+const
+{
+    return _input_recorder->isRecording();
+}
+
 /*!
  * Sets the maximum dimensions of the cached image previews.
  * Both width and height will be set to wh.
  * Bigger images will be shrunk to save memory.
+ *
+ * Previews are cached in the size of the thumbnails, rounded up
+ * to 64, 128, 256 etc. (up to this limit), so small thumbnails take
+ * less memory. When zooming out, smaller previews are derived
+ * from the cached ones. When zooming in, the cached ones are shown
+ * until the bigger ones have been loaded.
  */
 void
 ThumbnailBox::setPreviewSizeLimit(int wh)
@@ -600,6 +1890,10 @@ ThumbnailBox::setItemsClickable(bool enable)
  * to reduce the number of image requests and improve performance.
  *
  * Images that don't fit in the cache will be dropped and not be displayed.
+ *
+ * Converted pixmaps of recently drawn images are kept as well,
+ * so scrolling back doesn't convert them again. They may use up to
+ * a quarter of this limit on top of it.
  */
 void
 ThumbnailBox::setCacheLimit(int max_mb)
@@ -607,72 +1901,308 @@ ThumbnailBox::setCacheLimit(int max_mb)
     if (max_mb < 0) max_mb = 1; //need cache, enforce minimum size of 1 MB
     int max_bytes = max_mb * 1024 * 1024;
     _pixcache.setMaxCost(max_bytes);
+    _pixmapcache.setMaxCost(max_bytes / 4); //only the recently drawn ones
 }
 
 /*!
- * Adds action to the thumbnail context menu.
- * The ownership of action is not transferred.
- * Adding the first action will automatically create the menu.
+ * Sets the size limit of the compressed cache (in MB), 0 disables it.
+ *
+ * Images dropped from the cache (see setCacheLimit()) are compressed
+ * and kept in this cache. Decompressing them is faster than
+ * loading them again. They're compressed without loss (zlib),
+ * so they look exactly the same when they're shown again.
+ * A compressed image takes less memory (how much less depends
+ * on the image), so more images can be kept at the same cost.
+ * This cache is disabled by default.
  */
 void
-ThumbnailBox::addMenuItem(QAction *action)
+ThumbnailBox::setCompressedCacheLimit(int max_mb)
 {
-    if (!action) return;
-    if (!_actions.contains(action))
-    {
-        _actions << action;
-    }
+    if (max_mb < 0) max_mb = 0;
+    _compressed_cache.setMaxCost(max_mb * 1024 * 1024);
 }
 
 /*!
- * Removes given action from the thumbnail context menu.
- * Removing the only action will disable the menu.
+ * Sets the number of rows above and below the viewport
+ * whose images are loaded in advance, so they're ready when scrolling.
+ * Visible images are loaded first, closer rows before farther rows.
+ * Rows in the direction of the last scroll are preferred,
+ * only half as many rows are prefetched in the other direction.
+ *
+ * Prefetching is limited by the cache limit (see setCacheLimit()),
+ * it never evicts the visible images from the cache.
+ * It's disabled if the loader is synchronous.
  */
 void
-ThumbnailBox::removeMenuItem(QAction *action)
+ThumbnailBox::setPrefetchRows(int rows)
 {
-    if (action) _actions.removeAll(action);
-    else _actions.clear();
+    if (rows < 0) rows = 0;
+    _prefetch_rows = rows;
 }
 
 /*!
- * Removes previously defined custom thumbnail colors.
+ * Sets how thumbnails are drawn.
+ *
+ * If Painted is used, no thumbnail widgets are created at all.
+ * Instead, the whole grid is drawn in one paint event
+ * and clicks are mapped to the thumbnails by their position.
+ * The same signals are emitted as in Widgets mode.
+ * This is much faster if many small thumbnails are visible.
  */
 void
-ThumbnailBox::undefineColors()
+ThumbnailBox::setRenderMode(RenderMode mode)
 {
-    _colors.clear();
+    _render_mode = mode;
+    if (_input_recorder->isRecording())
+        _input_recorder->record(QString("mode %1").arg(
+                                mode == RenderMode::Painted ?
+                                "painted" : "widgets"));
+
+    //Hide thumbnail widgets, the area is drawn directly
+    if (mode == RenderMode::Painted)
+    {
+        foreach (Thumb *thumb, _thumb_pool)
+        {
+            thumb->hide();
+        }
+    }
+
+    updateThumbnails();
 }
 
 /*!
- * Defines a custom thumbnail color, identified by number, to be used later.
- * This will not change the color of any thumbnail.
- * The identifier number must not be 0.
+ * Sets the number of loader threads, which load (and shrink) images
+ * of the Local and LoaderFunction source types in the background.
+ * The default is the number of cpu cores.
+ *
+ * If count is 0, images are loaded synchronously in the gui thread,
+ * which is what a loader function that is not reentrant needs.
  */
 void
-ThumbnailBox::defineColor(const QColor &color, int number)
+ThumbnailBox::setLoaderThreadCount(int count)
 {
-    if (!number) return;
-    _colors[number] = color;
+    _loader->setThreadCount(count);
 }
 
 /*!
- * Resets the thumbnail color of all thumbnails
- * using the pre-defined color number.
- * If number is omitted, all thumbnails are reset.
+ * Enables the disk cache, which stores previews of local files
+ * in the given directory (which will be created).
+ * An empty directory disables the disk cache.
+ *
+ * Previews are identified by the file path, modification time and size,
+ * so a modified file will be loaded again.
+ * If the cache grows bigger than max_mb, the least recently used previews
+ * are removed.
+ *
+ * The disk cache is checked (by a loader thread) before the file is opened.
+ * It's only used by the Local source type.
  */
 void
-ThumbnailBox::clearColors(int number)
+ThumbnailBox::setDiskCache(const QString &directory, int max_mb)
+{
+    if (max_mb < 1) max_mb = 1;
+    DiskCache *disk_cache = _loader->diskCache();
+    disk_cache->setLimit((qint64)max_mb * 1024 * 1024);
+    disk_cache->setDirectory(directory);
+}
+
+/*!
+ * Enables or disables the use of thumbnails embedded in image files.
+ *
+ * Most camera jpegs contain a small thumbnail (like 160x120) in their
+ * Exif header. If it's at least as big as the thumbnail widgets,
+ * it is used instead of decoding the image, which means that
+ * only a few KB of the file are read.
+ * If it's missing or too small, the image is decoded as usual.
+ * This is enabled by default. It's only used by the Local source type.
+ */
+void
+ThumbnailBox::setEmbeddedThumbnailsEnabled(bool enable)
+{
+    _embedded_thumbnails = enable;
+}
+
+/*!
+ * Enables or disables smooth scrolling.
+ *
+ * By default, the viewport is scrolled by whole rows.
+ * With smooth scrolling, it's scrolled by pixels, rows at the edges
+ * may be partially visible. Pixel deltas of touchpads are used as they are.
+ * Scrolling moves the visible thumbnails (or what's been drawn,
+ * in Painted mode), only the items which come into view are bound.
+ */
+void
+ThumbnailBox::setSmoothScrollingEnabled(bool enable)
+{
+    if (enable == _smooth_scrolling) return;
+
+    //Stay at the same row, the scrollbar unit changes
+    //Its position is converted first (silently), the update sets its range
+    //and lays out the viewport once, in the new unit
+    int row = topRow();
+    _smooth_scrolling = enable;
+    if (_input_recorder->isRecording())
+        _input_recorder->record(QString("smooth %1").arg(enable ? 1 : 0));
+    _wheel_delta = 0;
+    int value = enable ? row * rowHeight() : row;
+    scrollbar->blockSignals(true);
+    scrollbar->setMaximum(qMax(scrollbar->maximum(), value));
+    scrollbar->setValue(value);
+    scrollbar->blockSignals(false);
+    updateThumbnails();
+}
+
+/*!
+ * Enables or disables checking local paths in the background.
+ *
+ * By default, setList() checks every local path before anything is shown,
+ * which may take a long time for big lists on slow (network) storage.
+ * If enabled, the list is shown immediately and checked in parallel.
+ * Paths that don't exist are removed in batches as they're found,
+ * validationProgress() is emitted for every checked batch
+ * and listValidated() once all paths have been checked.
+ * This is disabled by default. It's only used by the Local source type.
+ */
+void
+ThumbnailBox::setBackgroundValidationEnabled(bool enable)
+{
+    _background_validation = enable;
+}
+
+/*!
+ * Emits statisticsUpdated() every msec milliseconds, 0 disables it.
+ * This is disabled by default, statistics() can be called anytime.
+ */
+void
+ThumbnailBox::setStatisticsInterval(int msec)
+{
+    if (msec > 0) _statistics_timer->start(msec);
+    else _statistics_timer->stop();
+}
+
+/*!
+ * Resets all counters and times, see statistics().
+ */
+void
+ThumbnailBox::resetStatistics()
+{
+    _statistics = Statistics();
+    _cache_dropped = 0;
+    _cache_removed = 0;
+    _loader->resetTiming();
+}
+
+/*!
+ * Enables or disables recording spans (a timeline) of the work done
+ * for each image: requestImage, decode and shrinkImage (in the loader
+ * threads), cacheImage, pixmap conversion and updateThumbnails.
+ * Spans are tagged with the path, the index and the thread,
+ * see writeTrace(). A slow image shows up as a long span.
+ *
+ * This is disabled by default, nothing is recorded then.
+ * Spans are kept in memory until clearTrace() is called,
+ * up to a million, later ones are dropped.
+ */
+void
+ThumbnailBox::setTraceEnabled(bool enable)
+{
+    _loader->tracer()->setEnabled(enable);
+}
+
+/*!
+ * Deletes the recorded spans.
+ */
+void
+ThumbnailBox::clearTrace()
+{
+    _loader->tracer()->clear();
+}
+
+/*!
+ * Stops recording the input, see startInputRecording().
+ */
+void
+ThumbnailBox::stopInputRecording()
+{
+    _input_recorder->stop();
+}
+
+/*!
+ * Deletes all previews in the disk cache.
+ */
+void
+ThumbnailBox::clearDiskCache()
+{
+    _loader->diskCache()->clear();
+}
+
+/*!
+ * Adds action to the thumbnail context menu.
+ * The ownership of action is not transferred.
+ * Adding the first action will automatically create the menu.
+ */
+void
+ThumbnailBox::addMenuItem(QAction *action)
+{
+    if (!action) return;
+    if (!_actions.contains(action))
+    {
+        _actions << action;
+    }
+}
+
+/*!
+ * Removes given action from the thumbnail context menu.
+ * Removing the only action will disable the menu.
+ */
+void
+ThumbnailBox::removeMenuItem(QAction *action)
+{
+    if (action) _actions.removeAll(action);
+    else _actions.clear();
+}
+
+/*!
+ * Removes previously defined custom thumbnail colors.
+ */
+void
+ThumbnailBox::undefineColors()
+{
+    _colors.clear();
+}
+
+/*!
+ * Defines a custom thumbnail color, identified by number, to be used later.
+ * This will not change the color of any thumbnail.
+ * The identifier number must not be 0.
+ */
+void
+ThumbnailBox::defineColor(const QColor &color, int number)
+{
+    if (!number) return;
+    _colors[number] = color;
+}
+
+/*!
+ * Resets the thumbnail color of all thumbnails
+ * using the pre-defined color number.
+ * If number is omitted, all thumbnails are reset.
+ */
+void
+ThumbnailBox::clearColors(int number)
 {
     if (!number)
     {
         _file_colors.clear();
+        foreach (int index, visibleIndexes())
+            restyleThumbnail(index);
     }
     else
     {
         foreach (QString file, _file_colors.keys(number))
         {
             _file_colors.remove(file);
+            restyleThumbnail(file);
         }
     }
 }
@@ -685,6 +2215,9 @@ ThumbnailBox::setFileColor(const QString &file, int color)
 {
     if (!color) _file_colors.remove(file);
     else _file_colors[file] = color;
+
+    //Redraw thumbnail (if visible)
+    restyleThumbnail(file);
 }
 
 /*!
@@ -708,7 +2241,17 @@ ThumbnailBox::setFileColors(const QStringList &files, int color)
 void
 ThumbnailBox::clearCache()
 {
+    //Don't compress the dropped images, the compressed cache is cleared too
+    int compressed_limit = _compressed_cache.maxCost();
+    _compressed_cache.setMaxCost(0);
+    _cache_removed += _pixcache.count(); //not evicted
     _pixcache.clear();
+    _pixmapcache.clear();
+    _compressing.clear(); //images being compressed are dropped
+    _compressed_cache.setMaxCost(compressed_limit);
+
+    //Images that failed may be requested again
+    _failed_paths.clear();
 }
 
 /*!
@@ -721,20 +2264,74 @@ ThumbnailBox::clearCache()
 void
 ThumbnailBox::cacheImage(const QString &file, const QImage &image)
 {
-    //Put copy of QImage object (on heap) in cache (then managed by cache)
-    //Image is shrunk before its cached (original one likely exceeds limit)
-    QImage compressed_image = shrinkImage(image);
-    QImage *cached_image = new QImage(compressed_image); //on heap!
-    int size = cached_image->byteCount(); //size in bytes of compressed image
-    _pixcache.insert(file, cached_image, size); //ownership goes to cache
-    if (!_pixcache.contains(file))
-        return; //not cached (too big?), stop
+    Tracer *tracer = this->tracer();
+    TraceSpan span(tracer, "cacheImage", file, tracer ? indexOf(file) : -1);
+
+    //Cache image, stop if it wasn't cached (failed or too big)
+    int level;
+    if (!storeImage(file, image, level)) return;
     emit imageCached(file);
 
     //Draw image on thumbnail widget (if thumbnail visible)
     //Updating the whole thumbnail area would be overkill
     updateThumbnail(file);
 
+    //Requested before the thumbnails were resized, request the new size
+    if (level != previewLevel() && _wanted_paths.contains(file))
+        requestImage(file, _wanted_paths.value(file));
+
+}
+
+/*!
+ * Receives and caches a batch of images, files and images are
+ * matched by position. This is the same as calling cacheImage()
+ * for each of them, but imageCached() is emitted once per batch
+ * (without a path) and the thumbnails are redrawn at once.
+ * External loaders should use this, it's much cheaper
+ * than delivering images one by one.
+ */
+void
+ThumbnailBox::cacheImages(const QStringList &files, const QList<QImage> &images)
+{
+    TraceSpan span(tracer(), "cacheImages");
+
+    //Cache all images first
+    QStringList cached_files;
+    QStringList outdated_files;
+    int count = qMin(files.size(), images.size());
+    for (int i = 0; i < count; i++)
+    {
+        int level;
+        const QString &file = files.at(i);
+        if (!storeImage(file, images.at(i), level)) continue;
+        cached_files << file;
+        if (level != previewLevel() && _wanted_paths.contains(file))
+            outdated_files << file;
+    }
+    if (cached_files.isEmpty()) return;
+    emit imageCached();
+
+    //Draw images on visible thumbnails
+    //In Painted mode, the area covering all of them is redrawn once
+    QRect dirty_rect;
+    foreach (const QString &file, cached_files)
+    {
+        foreach (int index, _visible_paths.values(file))
+        {
+            if (thumbAtIndex(index))
+            {
+                updateThumbnail(index);
+                continue;
+            }
+            _painted_thumbs[index].pixmap = cachedPixmap(file);
+            dirty_rect |= thumbRect(index);
+        }
+    }
+    if (!dirty_rect.isEmpty()) thumbarea->update(dirty_rect);
+
+    //Requested before the thumbnails were resized, request the new size
+    foreach (const QString &file, outdated_files)
+        requestImage(file, _wanted_paths.value(file));
 }
 
 /*!
@@ -743,6 +2340,7 @@ ThumbnailBox::cacheImage(const QString &file, const QImage &image)
 void
 ThumbnailBox::scrollToRow(int row)
 {
+    if (smoothScrollingEnabled()) row *= rowHeight(); //scrollbar in pixels
     scrollbar->setValue(row);
 }
 
@@ -774,6 +2372,7 @@ ThumbnailBox::updateThumbnails()
     int count = this->count(); //total number of files
     int thumbwidth;
     int thumbheight;
+    int rowheight; //thumbnail height incl. padding
     int padding = 5;
     int cols;
     int rows;
@@ -784,6 +2383,11 @@ ThumbnailBox::updateThumbnails()
     int scrollpos;
     int hiddenrows; //rows hidden ABOVE viewport
     int hiddenthumbs; //thumbs hidden ABOVE viewport
+    int offset; //pixels of top row hidden ABOVE viewport (smooth scrolling)
+
+    //Only scrolled (see scrollThumbnails()), reset before anything else
+    bool scrolled = _scroll_only;
+    _scroll_only = false;
 
     //Prevent update when disabled (loading)
     if (!isEnabled()) return;
@@ -791,12 +2395,16 @@ ThumbnailBox::updateThumbnails()
     //Prevent second call
     if (updating_thumbnails) return;
     updating_thumbnails = true;
+    QElapsedTimer timer;
+    timer.start();
+    TraceSpan span(tracer(), "updateThumbnails");
 
-    //Dimensions
+    //Thumbnail size
     int thumbsize = thumbWidth();
     thumbwidth = thumbsize;
     if (thumbwidth < 30) thumbwidth = 30;
     thumbheight = thumbwidth;
+    rowheight = thumbheight + padding;
 
     //Numbers
     cols = columnCount(); //2.9 -> 2
@@ -812,125 +2420,173 @@ ThumbnailBox::updateThumbnails()
 
     //Recreational activities (what)
     //Everytime an update is triggered,
-    //the thumbnail area widget is recreated
-    //and filled with the visible thumbs, which are also recreated.
+    //the visible thumbs are rebound to the items in the viewport.
+    //Thumbs are recycled, a new one is only created
+    //if the viewport holds more thumbs than ever before.
     //This is important for large directories (> 1000 items),
     //because creating 1000 thumbs is inefficient/stupid/sigsegv.
-
-    //Clear list of visible thumbnails (recreated below)
+    //It also means that scrolling does not allocate any widgets.
+    //If the viewport was only scrolled, thumbs which stay visible
+    //keep their item and are just moved.
+
+    //Thumbs of the last update, kept if only scrolled
+    bool keep = scrolled &&
+                cols == _viewport_columns &&
+                thumbwidth == _viewport_thumb_size;
+    QMap<int, QPointer<Thumb>> previous;
+    QHash<int, PaintedThumb> previous_painted;
+    if (keep) previous = _visible_thumbnails_in_viewport;
+    if (keep) previous_painted = _painted_thumbs;
+    int previous_pos = _viewport_scroll_pos;
+
+    //Clear list of visible thumbnails (refilled below)
     _visible_thumbnails_in_viewport.clear();
+    _visible_paths.clear();
+    _painted_thumbs.clear();
+    _wanted_paths.clear();
+    _thumbs_created = 0;
+    _thumbs_reused = 0;
 
-    //Recreate thumbnail area
-    //The 2013 easter egg:
-    //if (thumbarea) delete thumbarea; //SIGSEGV (we found an easter egg)
-    if (thumbarea)
+    //Scrollbar position
+    if (smoothScrollingEnabled())
     {
-        thumbarea->hide();
-        thumbarea->deleteLater();
+        //Scrollbar in pixels, rows may be partially visible
+        int availableheight = availableHeight();
+        int totalheight = totalrows * rowheight + padding;
+        scrollbar->setSingleStep(rowheight);
+        scrollbar->setPageStep(qMax(availableheight, 1));
+        scrollbar->setMaximum(qMax(totalheight - availableheight, 0));
+        scrollpos = scrollbar->value();
+        hiddenrows = scrollpos / rowheight;
+        offset = scrollpos % rowheight;
+        int lastrow = (scrollpos + availableheight - padding - 1) / rowheight;
+        rows = qMax(lastrow - hiddenrows + 1, 1);
+    }
+    else
+    {
+        scrollbar->setSingleStep(1);
+        scrollbar->setPageStep(rows);
+        if (totalhiddenrows >= 0) scrollbar->setMaximum(totalhiddenrows);
+        scrollpos = scrollbar->value();
+        hiddenrows = scrollpos;
+        offset = 0;
     }
-    thumbarea = new QWidget;
-    thumbcontainerlayout->insertWidget(0, thumbarea);
-    thumbarea->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
-    scrollbar->setPageStep(rows);
-    QVBoxLayout *vbox_rows = new QVBoxLayout;
-    thumbarea->setLayout(vbox_rows);
-
-    //Scrollbar position
-    if (totalhiddenrows >= 0) scrollbar->setMaximum(totalhiddenrows);
-    scrollpos = scrollbar->value();
-    hiddenrows = scrollpos;
     hiddenthumbs = hiddenrows * cols;
 
-    //Create thumbnails
-    for (int i = 0; i < rows; i++)
+    //Viewport geometry, see thumbRect()
+    _viewport_first_index = hiddenthumbs;
+    _viewport_columns = cols;
+    _viewport_thumb_size = thumbwidth;
+    _viewport_offset = offset;
+    _viewport_scroll_pos = hiddenrows * rowheight + offset;
+
+    //Items in viewport
+    int first = hiddenthumbs;
+    int last = qMin(hiddenthumbs + rows * cols, count); //exclusive
+
+    //Thumbs still showing an item in the viewport
+    QSet<Thumb*> kept;
+    QMap<int, QPointer<Thumb>>::const_iterator it;
+    for (it = previous.constBegin(); it != previous.constEnd(); ++it)
+    {
+        if (it.key() >= first && it.key() < last && it.value())
+            kept.insert(it.value());
+    }
+    QList<Thumb*> unused;
+    foreach (Thumb *thumb, _thumb_pool)
+    {
+        if (!kept.contains(thumb)) unused << thumb;
+    }
+
+    //Bind thumbnails
+    bool painted = renderMode() == RenderMode::Painted;
+    for (int absindex = first; absindex < last; absindex++)
     {
-        //Row
-        QHBoxLayout *hbox_row = new QHBoxLayout;
-        hbox_row->setSpacing(padding);
-        for (int j = 0; j < cols; j++)
+        //Painted mode, no widget, thumbnail drawn by paintThumbnails()
+        if (painted)
         {
-            //Column
-            int relindex = i * cols + j;
-            int absindex = relindex + hiddenthumbs;
-            if (absindex >= count) break; //no more thumbs, row not filled
-            int index = this->index();
-
-            //Item title
-            QString title = itemTitle(absindex);
-
-            //Create item thumbnail object
-            Thumb *thumb = new Thumb(absindex);
-            thumb->setEnabled(itemsClickable());
-            connect(thumb,
-                    SIGNAL(clicked(int)),
-                    SLOT(select(int)));
-            thumb->setFixedSize(QSize(thumbwidth, thumbheight));
-            thumb->setFrameStyle(QFrame::Panel | QFrame::Raised);
-            if (absindex == index) thumb->setFrameShadow(QFrame::Sunken);
-            thumb->setLineWidth(3);
-            thumb->setToolTip(title);
-            QColor clr_bg = fileColor(itemPath(absindex));
-            if (clr_bg.isValid())
+            //Still bound to this item, keep what's been prepared
+            if (previous_painted.contains(absindex))
             {
-                thumb->setAutoFillBackground(true);
-                QPalette palette = thumb->palette();
-                palette.setColor(QPalette::Window, clr_bg);
-                thumb->setPalette(palette);
+                PaintedThumb item = previous_painted.value(absindex);
+                _painted_thumbs[absindex] = item;
+                _visible_thumbnails_in_viewport[absindex] = 0;
+                _visible_paths.insert(item.path, absindex);
+                if (_requested_paths.contains(item.path))
+                    _wanted_paths[item.path] = 0; //still loading
+                continue;
             }
-            hbox_row->addWidget(thumb);
+            bindPaintedThumb(absindex);
+            continue;
+        }
 
-            //Add to list of visible thumbnails
+        //Thumb still bound to this item, just move it
+        Thumb *thumb = previous.value(absindex);
+        if (thumb)
+        {
+            QString path = thumb->path(); //path, uri
+            thumb->move(thumbRect(absindex).topLeft());
             _visible_thumbnails_in_viewport[absindex] = thumb;
+            _visible_paths.insert(path, absindex);
+            if (_requested_paths.contains(path))
+                _wanted_paths[path] = 0; //still loading
+            _thumbs_reused++;
+            continue;
+        }
+
+        //Get unused thumbnail from pool or create a new one
+        if (!unused.isEmpty())
+        {
+            thumb = unused.takeFirst();
+            _thumbs_reused++;
+        }
+        else
+        {
+            thumb = createThumb();
+            _thumb_pool << thumb;
+            _thumbs_created++;
+        }
 
-            //Set title
-            thumb->setTitle(title);
+        //Position in viewport
+        thumb->setFixedSize(QSize(thumbwidth, thumbheight));
+        thumb->move(thumbRect(absindex).topLeft());
 
-            //Load image (if available)
-            QString path = itemPath(absindex); //path, uri
-            QPixmap cached_pixmap = cachedPixmap(path);
-            if (!cached_pixmap.isNull())
-            {
-                //Got it, draw it
-                thumb->setPixmap(cached_pixmap); //from internal cache
-            }
-            else
-            {
-                //Not cached, request it
-                //It will be drawn later
-                //Request should be processed in background (ideally)
-                requestImage(path);
-            }
+        //Rebind thumbnail to item, load image
+        bindThumb(thumb, absindex);
+        thumb->show();
 
-            //Connect thumbnail signals
-            connect(thumb,
-                    SIGNAL(clicked(int)),
-                    SIGNAL(clicked(int)));
-            connect(thumb,
-                    SIGNAL(clicked(int, const QPoint&)),
-                    SIGNAL(clicked(int, const QPoint&)));
-            connect(thumb,
-                    SIGNAL(rightClicked(int)),
-                    SIGNAL(rightClicked(int)));
-            connect(thumb,
-                    SIGNAL(rightClicked(int, const QPoint&)),
-                    SIGNAL(rightClicked(int, const QPoint&)));
-            connect(thumb,
-                    SIGNAL(contextMenuRequested(const QPoint&)),
-                    SIGNAL(contextMenuRequested(const QPoint&)));
-            connect(thumb,
-                    SIGNAL(middleClicked(int)),
-                    SIGNAL(middleClicked(int)));
-            connect(thumb,
-                    SIGNAL(middleClicked(int, const QPoint&)),
-                    SIGNAL(middleClicked(int, const QPoint&)));
+    }
 
-        }
+    //Hide remaining thumbnails (not needed in this viewport)
+    foreach (Thumb *thumb, unused)
+    {
+        thumb->hide();
+    }
 
-        //Add row to layout
-        hbox_row->addStretch(1);
-        vbox_rows->addLayout(hbox_row);
+    //Redraw painted thumbnails
+    //If only scrolled, move what's been drawn and draw the uncovered part
+    if (painted)
+    {
+        int dy = previous_pos - _viewport_scroll_pos;
+        if (keep && qAbs(dy) < thumbarea->height())
+            thumbarea->scroll(0, dy);
+        else
+            thumbarea->update();
     }
-    vbox_rows->addStretch(1);
+
+    //Scroll direction, prefetch rows in this direction
+    if (scrollpos != _last_scroll_pos)
+        _scroll_direction = scrollpos > _last_scroll_pos ? 1 : -1;
+    _last_scroll_pos = scrollpos;
+    prefetchImages(hiddenrows, hiddenrows + rows - 1, cols);
+
+    //Cancel requests that have left the window, reprioritize the others
+    cancelRequests();
+
+    //Time spent, without the handlers of updated()
+    _statistics.updates++;
+    _statistics.thumbs_created += _thumbs_created;
+    _statistics.update_time.add(timer.nsecsElapsed() / 1000);
 
     //Let the world know
     emit updated();
@@ -939,6 +2595,17 @@ ThumbnailBox::updateThumbnails()
     updating_thumbnails = false;
 }
 
+void
+ThumbnailBox::scrollThumbnails(int value)
+{
+    //The viewport was scrolled, nothing else has changed
+    //Thumbnails which stay visible are moved rather than rebound
+    if (_input_recorder->isRecording())
+        _input_recorder->record(QString("scroll %1").arg(value));
+    _scroll_only = true;
+    updateThumbnails();
+}
+
 /*!
  * This is a convenience function.
  */
@@ -968,6 +2635,8 @@ ThumbnailBox::setThumbSize(double percent)
     if (percent < 0) percent = 0;
     if (percent > 1) percent = 1;
     _size = percent;
+    if (_input_recorder->isRecording())
+        _input_recorder->record(QString("size %1").arg(percent));
 
     updateThumbnails();
 
@@ -1010,7 +2679,10 @@ ThumbnailBox::select(int index, bool send_signal)
 
     if (!isValidIndex(index)) index = -1;
     if (index == this->index()) return; //don't re-select selected item
+    int previous = _index;
     _index = index;
+    if (_input_recorder->isRecording())
+        _input_recorder->record(QString("select %1").arg(index));
 
     //The 2013 easter egg:
     //We realize that closing the "File not found" message box
@@ -1041,7 +2713,11 @@ ThumbnailBox::select(int index, bool send_signal)
     //This function emits signals... Signals that belong to thumbnails...
     //Thumbnails that have been DELETEd by the update function!!!
     //Happy easter everyone!
-    updateThumbnails();
+    //Thumbs are recycled now, none of them are deleted.
+    //Only the previously and the newly selected thumbnail are redrawn,
+    //the view is updated if the selected item is scrolled into view.
+    restyleThumbnail(previous);
+    restyleThumbnail(index);
 
     emit selectionChanged();
     if (index != -1 && send_signal)
@@ -1115,10 +2791,71 @@ ThumbnailBox::ensureItemVisible(int index)
 void
 ThumbnailBox::setImageSource(QImage(*loader)(const QString&))
 {
+    releaseImageLoader();
     _image_loader_function = loader;
     _source_type = SourceType::LoaderFunction;
 }
 
+/*!
+ * Defines a loader object that will be used to load the images.
+ * This also sets the loader source type accordingly (LoaderObject).
+ *
+ * It's called from loader threads (possibly several at once)
+ * and must not be deleted while this ThumbnailBox is using it.
+ * Queued requests for the previous loader object are dropped.
+ */
+void
+ThumbnailBox::setImageSource(ImageLoader *loader)
+{
+    _source_type = SourceType::LoaderObject;
+    if (loader == _image_loader) return;
+    releaseImageLoader();
+    _image_loader = loader;
+    if (!loader) return;
+
+    //Loaded images are delivered in batches, from any thread
+    connect(loader,
+            SIGNAL(loaded(const QStringList&, const QList<QImage>&)),
+            SLOT(cacheImages(const QStringList&, const QList<QImage>&)));
+}
+
+/*!
+ * This is a convenience function.
+ * The function object (which may carry state, like a lambda)
+ * is called with each path and the requested size, in a loader thread.
+ * See FunctionImageLoader.
+ *
+ * The loader object created for it is deleted when another
+ * image source is set.
+ */
+void
+ThumbnailBox::setImageSource(const std::function<QImage(const QString&,
+                                                        const QSize&)> &loader)
+{
+    FunctionImageLoader *function_loader =
+        new FunctionImageLoader(loader, this);
+    setImageSource(function_loader);
+    _function_image_loader = function_loader;
+}
+
+void
+ThumbnailBox::releaseImageLoader()
+{
+    //Stop using the current loader object (if any)
+    //Its queued requests are dropped, running ones are forgotten,
+    //their images are not delivered anymore
+    //Our own loader (function object) is deleted once no job is using it
+    if (_image_loader)
+    {
+        disconnect(_image_loader, 0, this, 0);
+        _loader->releaseImageLoader(_image_loader,
+                                    _image_loader == _function_image_loader);
+        _requested_paths.clear();
+    }
+    _image_loader = 0;
+    _function_image_loader = 0;
+}
+
 /*!
  * Clears the ThumbnailBox.
  *
@@ -1137,9 +2874,22 @@ ThumbnailBox::clear()
     //Reset position
     _index = -1;
 
-    //Clear list
-    QStringList &list = _list;
-    list.clear();
+    //Drop queued image requests (obsolete)
+    _wanted_paths.clear();
+    cancelRequests();
+
+    //Stop checking the old list
+    _validator->cancel();
+    _invalid_paths.clear();
+
+    //Images of the new list may be loadable, try again
+    _failed_paths.clear();
+
+    //Clear list, drop custom provider
+    if (_provider && _provider != _list_provider)
+        disconnect(_provider, 0, this, 0);
+    _provider = _list_provider;
+    _list_provider->setList(QStringList());
 
     //Cache not cleared by default, could be reused
 
@@ -1175,21 +2925,33 @@ ThumbnailBox::setList(const QStringList &paths, int selected, SourceType type)
     _index = selected;
 
     //Check and add provided paths to list of thumbnails
-    QStringList &list = _list;
+    //If they're checked in the background, they're all added for now
+    QStringList list;
+    list.reserve(paths.size());
+    bool validate = type == SourceType::Local && backgroundValidationEnabled();
     foreach (QString path, paths)
     {
-        if (type == SourceType::Local)
+        if (validate)
+        {
+            //Full local path, without touching the file system
+            path = QDir::cleanPath(QDir::current().absoluteFilePath(path));
+        }
+        else if (type == SourceType::Local)
         {
-            QFileInfo inf(path);
-            if ((!inf.isFile()) &&
-                (!inf.isDir() || !directoriesVisible()))
+            if (!Validator::isValidPath(path, directoriesVisible()))
             {
                 continue; //not found, ignore invalid entry
             }
-            path = inf.absoluteFilePath(); //full local path
+            path = QFileInfo(path).absoluteFilePath(); //full local path
         }
         list << path;
     }
+    _list_provider->setList(list);
+    recordItems();
+
+    //Check paths in the background, invalid ones are removed later
+    if (validate)
+        _validator->start(list, directoriesVisible());
 
     //Re-enable
     setEnabled(true);
@@ -1243,12 +3005,13 @@ ThumbnailBox::setList(const QStringList &remote_paths,
     if (remote_paths.isEmpty()) return false;
 
     //Apply source type and loader function
+    releaseImageLoader();
     _source_type = SourceType::LoaderFunction;
     _image_loader_function = loader;
 
     //Set list
-    QStringList &list = _list;
-    list = remote_paths;
+    _list_provider->setList(remote_paths);
+    recordItems();
 
     //Re-enable
     setEnabled(true);
@@ -1262,57 +3025,1958 @@ ThumbnailBox::setList(const QStringList &remote_paths,
     return true;
 }
 
-ThumbnailBoxComponents::Thumb::Thumb(int index, QWidget *parent)
-                      : QFrame(parent),
-                        index(index)
+void
+ThumbnailBox::collectInvalidPaths(const QStringList &paths, int checked,
+                                  int total)
 {
-    //Create layout
-    QVBoxLayout *vbox = new QVBoxLayout;
-    lbl_preview = new QLabel;
-    lbl_preview->setScaledContents(true);
-    vbox->addWidget(lbl_preview);
-    lbl_title = new QLabel;
-    lbl_title->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Fixed);
-    vbox->addWidget(lbl_title);
-    setLayout(vbox);
+    emit validationProgress(checked, total);
 
+    //Invalid paths are collected and removed in batches
+    //Removing them one by one would rebuild the list for each of them
+    foreach (QString path, paths)
+        _invalid_paths.insert(path);
+    if (_invalid_paths.isEmpty() || _invalid_paths_scheduled) return;
+    _invalid_paths_scheduled = true;
+    QTimer::singleShot(200, this, SLOT(removeInvalidPaths()));
 }
 
 void
-ThumbnailBoxComponents::Thumb::setPixmap(const QPixmap &preview)
+ThumbnailBox::removeInvalidPaths()
 {
-    lbl_preview->setPixmap(preview);
+    _invalid_paths_scheduled = false;
+    if (_invalid_paths.isEmpty()) return;
+
+    //Remember selected item, its index may change
+    QString selected = itemPath();
+
+    //Remove invalid paths from list (in place, the list may be huge)
+    //Not recorded, it's not input (a replay validates the list itself)
+    _list_provider->remove(_invalid_paths);
+    _invalid_paths.clear();
+
+    //Restore selection, unless the selected item was removed
+    int index = indexOf(selected);
+    bool selection_changed = index != _index;
+    _index = index;
+
+    //Update view (unless disabled)
+    updateThumbnails();
+
+    if (selection_changed) emit selectionChanged();
 }
 
 void
-ThumbnailBoxComponents::Thumb::setTitle(const QString &title)
+ThumbnailBox::finishValidation()
 {
-    lbl_title->setText(title);
+    //Remove the last batch now, the list is final
+    removeInvalidPaths();
+    emit listValidated();
 }
 
-void
-ThumbnailBoxComponents::Thumb::mousePressEvent(QMouseEvent *event)
+bool
+ThumbnailBox::storeImage(const QString &file, const QImage &image,
+                         int &level)
 {
-    //The 2013 easter egg:
-    //It (SIGSEGV) is triggered by those signals,
-    //because the widgets have been deleted by the update function.
-
-    if (event->button() == Qt::LeftButton)
+    //Request answered (if it was requested), in the requested size
+    //An empty image means it could not be loaded, don't request it again
+    level = _requested_paths.contains(file) ?
+            _requested_paths.take(file) : previewLevel();
+    if (image.isNull())
     {
-        emit clicked(index);
-        emit clicked(index, event->globalPos());
+        _failed_paths.insert(file);
+        _statistics.requests_failed++;
+        return false;
     }
-    else if (event->button() == Qt::RightButton)
+
+    //Drop outdated images of this file (if previously cached), all sizes
+    //They're discarded, not compressed (they're not evicted either)
+    foreach (int cached_level, previewLevels())
     {
-        emit rightClicked(index);
-        emit rightClicked(index, event->globalPos());
-        emit contextMenuRequested(event->globalPos());
+        QString key = cacheKey(file, cached_level);
+        _compressed_cache.remove(key);
+        _compressing.remove(key);
+        CachedImage *cached_image = _pixcache.take(key);
+        if (!cached_image) continue;
+        cached_image->discard();
+        delete cached_image;
     }
-    else if (event->button() == Qt::MidButton)
+
+    //Put copy of QImage object (on heap) in cache (then managed by cache)
+    //Image is shrunk before its cached (original one likely exceeds limit)
+    //Smaller sizes are derived from it when needed, see cachedImage()
+    //Images from loader threads are small already, only big ones are timed
+    QString key = cacheKey(file, level);
+    bool big = image.width() > level || image.height() > level;
+    QElapsedTimer timer;
+    timer.start();
+    QImage shrunk_image;
     {
-        emit middleClicked(index);
+        TraceSpan span(big ? tracer() : 0, "shrinkImage", file);
+        shrunk_image = shrinkImage(image, QSize(level, level));
+    }
+    if (big) _statistics.shrink_time.add(timer.nsecsElapsed() / 1000);
+    insertCachedImage(key, shrunk_image);
+    _compressed_cache.remove(key); //outdated (if previously cached)
+    _compressing.remove(key);
+    return _pixcache.contains(key); //not cached if too big
+}
+
+void
+ThumbnailBox::flushImageRequests()
+{
+    //Requests of External images since the last flush, in one signal
+    //Requests that have been cancelled in the meantime are left out
+    QStringList paths;
+    foreach (const QString &path, _requested_batch)
+    {
+        if (_requested_paths.contains(path)) paths << path;
+    }
+    _requested_batch.clear();
+    if (!paths.isEmpty()) emit imagesRequested(paths);
+}
+
+void
+ThumbnailBox::emitStatistics()
+{
+    emit statisticsUpdated(statistics());
+}
+
+void
+ThumbnailBox::storeCompressed(const QString &key, int ticket,
+                              const QByteArray &data)
+{
+    //Compressed image from a loader thread, see dropCachedImage()
+    //Dropped if the image has been replaced or the cache cleared since
+    if (_compressing.value(key, 0) != ticket) return;
+    _compressing.remove(key);
+    if (data.isEmpty() || _compressed_cache.maxCost() <= 0) return;
+    if (_compressed_cache.contains(key)) return;
+    QByteArray *cached_data = new QByteArray(data); //on heap!
+    _compressed_cache.insert(key, cached_data, data.size()); //owned by cache
+}
+
+void
+ThumbnailBox::resetItems()
+{
+    //The provider's items have changed (or it has been deleted)
+    //The selection stays at its position, if it still exists
+    int index = isValidIndex(_index) ? _index : -1;
+    bool selection_changed = index != _index;
+    _index = index;
+    recordItems();
+
+    //Update view (unless disabled)
+    updateThumbnails();
+
+    if (selection_changed) emit selectionChanged();
+}
+
+void
+ThumbnailBox::updateItems(int first, int count)
+{
+    //Items have changed, rebind the thumbnails if any of them is visible
+    foreach (int index, _visible_thumbnails_in_viewport.keys())
+    {
+        if (index < first || index >= first + count) continue;
+        updateThumbnails();
+        return;
+    }
+}
+
+void
+ThumbnailBox::recordItems()
+{
+    //New list (or items removed), only the size is recorded
+    if (_input_recorder->isRecording())
+        _input_recorder->record(QString("list %1").arg(count()));
+}
+
+/*!
+ * Fills the ThumbnailBox with the items of the given provider,
+ * instead of a list (see setList()). The provider is asked
+ * for the items when they're needed, which are the visible ones
+ * and the prefetched rows around them, so a huge catalog
+ * (like a database) doesn't have to be copied into a list.
+ * Paths are not checked, not even those of local files.
+ * The image source (see setImageSource()) is kept.
+ *
+ * The provider is not owned by this ThumbnailBox.
+ * It's used until another list or provider is set,
+ * or until it's deleted.
+ */
+bool
+ThumbnailBox::setItemProvider(ItemProvider *provider, SourceType type)
+{
+    //Clear list
+    clear();
+    if (!provider) return false;
+
+    //Apply source type and provider
+    _source_type = type;
+    _provider = provider;
+    connect(provider, SIGNAL(itemsReset()), SLOT(resetItems()));
+    connect(provider,
+            SIGNAL(itemsChanged(int, int)),
+            SLOT(updateItems(int, int)));
+    connect(provider, SIGNAL(destroyed()), SLOT(resetItems()));
+    recordItems();
+
+    //Re-enable
+    setEnabled(true);
+
+    //Draw thumbnails
+    scheduleUpdateThumbnails(0);
+
+    //Emit selection signal
+    emit selectionChanged();
+
+    return true;
+}
+
+/*!
+ * Fills the ThumbnailBox with the given list of remote thumbnails,
+ * which are loaded by the given loader object (LoaderObject source type).
+ */
+bool
+ThumbnailBox::setList(const QStringList &remote_paths, ImageLoader *loader)
+{
+    //Clear list
+    clear();
+    if (remote_paths.isEmpty()) return false;
+
+    //Apply source type and loader object
+    setImageSource(loader);
+
+    //Set list
+    _list_provider->setList(remote_paths);
+    recordItems();
+
+    //Re-enable
+    setEnabled(true);
+
+    //Draw thumbnails
+    scheduleUpdateThumbnails(0);
+
+    //Emit selection signal
+    emit selectionChanged();
+
+    return true;
+}
+
+ThumbnailBox::Histogram::Histogram()
+                      : buckets(24, 0), //up to 2^23 us (8 s)
+                        count(0),
+                        total_us(0),
+                        max_us(0)
+{
+}
+
+/*!
+ * Adds a sample (a duration in microseconds).
+ */
+void
+ThumbnailBox::Histogram::add(qint64 microseconds)
+{
+    if (microseconds < 0) return;
+    int bucket = 0;
+    while (bucket < buckets.size() - 1 &&
+           (Q_INT64_C(1) << bucket) <= microseconds)
+        bucket++;
+    buckets[bucket]++;
+    count++;
+    total_us += microseconds;
+    max_us = qMax(max_us, microseconds);
+}
+
+/*!
+ * Adds the samples of another histogram.
+ */
+void
+ThumbnailBox::Histogram::merge(const Histogram &other)
+{
+    for (int i = 0; i < buckets.size() && i < other.buckets.size(); i++)
+        buckets[i] += other.buckets.at(i);
+    count += other.count;
+    total_us += other.total_us;
+    max_us = qMax(max_us, other.max_us);
+}
+
+/*!
+ * Returns the average duration in microseconds.
+ */
+qint64
+ThumbnailBox::Histogram::mean()
+const
+{
+    return count ? total_us / count : 0;
+}
+
+/*!
+ * Returns the duration (in microseconds) that the given fraction
+ * of the samples took at most, e.g. 0.99 for the 99th percentile.
+ * It's the upper bound of the bucket, so it's accurate within a factor of 2.
+ */
+qint64
+ThumbnailBox::Histogram::percentile(double fraction)
+const
+{
+    qint64 wanted = qMax((qint64)(fraction * count + .5), Q_INT64_C(1));
+    qint64 seen = 0;
+    for (int i = 0; i < buckets.size() - 1; i++)
+    {
+        seen += buckets.at(i);
+        if (seen >= wanted) return qMin(Q_INT64_C(1) << i, max_us);
+    }
+    return max_us;
+}
+
+ThumbnailBox::Statistics::Statistics()
+                       : cache_hits(0),
+                         cache_misses(0),
+                         compressed_hits(0),
+                         derived_hits(0),
+                         cache_evictions(0),
+                         cache_items(0),
+                         cache_bytes(0),
+                         compressed_bytes(0),
+                         pixmap_bytes(0),
+                         requests_issued(0),
+                         requests_deduplicated(0),
+                         requests_cancelled(0),
+                         requests_failed(0),
+                         updates(0),
+                         thumbs_created(0)
+{
+}
+
+ThumbnailBoxComponents::Thumb::Thumb(int index, QWidget *parent)
+                      : QFrame(parent),
+                        index(index)
+{
+    //Create layout
+    QVBoxLayout *vbox = new QVBoxLayout;
+    lbl_preview = new QLabel;
+    lbl_preview->setScaledContents(true);
+    vbox->addWidget(lbl_preview);
+    lbl_title = new QLabel;
+    lbl_title->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Fixed);
+    vbox->addWidget(lbl_title);
+    setLayout(vbox);
+
+}
+
+void
+ThumbnailBoxComponents::Thumb::setIndex(int index)
+{
+    this->index = index;
+}
+
+QString
+ThumbnailBoxComponents::Thumb::path()
+const
+{
+    return item_path;
+}
+
+void
+ThumbnailBoxComponents::Thumb::setPath(const QString &path)
+{
+    item_path = path;
+}
+
+void
+ThumbnailBoxComponents::Thumb::setPixmap(const QPixmap &preview)
+{
+    lbl_preview->setPixmap(preview);
+}
+
+void
+ThumbnailBoxComponents::Thumb::setTitle(const QString &title)
+{
+    lbl_title->setText(title);
+}
+
+void
+ThumbnailBoxComponents::Thumb::mousePressEvent(QMouseEvent *event)
+{
+    //The 2013 easter egg:
+    //It (SIGSEGV) is triggered by those signals,
+    //because the widgets have been deleted by the update function.
+    //Thumbs are recycled now, but a slot connected to the first signal
+    //may rebind this thumb, so the index is copied first.
+    int index = this->index;
+
+    if (event->button() == Qt::LeftButton)
+    {
+        emit clicked(index);
+        emit clicked(index, event->globalPos());
+    }
+    else if (event->button() == Qt::RightButton)
+    {
+        emit rightClicked(index);
+        emit rightClicked(index, event->globalPos());
+        emit contextMenuRequested(event->globalPos());
+    }
+    else if (event->button() == Qt::MidButton)
+    {
+        emit middleClicked(index);
         emit middleClicked(index, event->globalPos());
     }
     event->accept();
 }
 
+ThumbnailBoxComponents::CachedImage::CachedImage(const QString &key,
+                                                 const QImage &image,
+                                                 const ThumbnailBox *box)
+                           : _key(key),
+                             _image(image),
+                             _box(box)
+{
+}
+
+ThumbnailBoxComponents::CachedImage::~CachedImage()
+{
+    //Dropped from the cache, the box keeps a compressed copy (if enabled)
+    //Nothing is compressed here, this runs in the gui thread
+    if (_box) _box->dropCachedImage(_key, _image);
+}
+
+QImage
+ThumbnailBoxComponents::CachedImage::image()
+const
+{
+    return _image;
+}
+
+/*!
+ * Detaches the image from the box, so it's not kept (compressed)
+ * when it's deleted. This is for outdated images.
+ */
+void
+ThumbnailBoxComponents::CachedImage::discard()
+{
+    _box = 0;
+}
+
+/*!
+ * Compresses the image without loss: its size and format,
+ * followed by its pixels, compressed with zlib (fast to decode).
+ * Images with a color table are converted first.
+ */
+QByteArray
+ThumbnailBoxComponents::CachedImage::compress(const QImage &image)
+{
+    QImage pixels = image;
+    if (pixels.colorCount())
+        pixels = pixels.convertToFormat(QImage::Format_ARGB32);
+
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << (qint32)pixels.width() << (qint32)pixels.height()
+           << (qint32)pixels.format() << (qint32)pixels.bytesPerLine();
+    stream << qCompress(pixels.constBits(), pixels.byteCount(), 1);
+    return data;
+}
+
+QImage
+ThumbnailBoxComponents::CachedImage::decompress(const QByteArray &data)
+{
+    qint32 width, height, format, bytes_per_line;
+    QByteArray compressed;
+    QDataStream stream(data);
+    stream >> width >> height >> format >> bytes_per_line >> compressed;
+    if (stream.status() != QDataStream::Ok) return QImage();
+
+    //Copy line by line, the image might be aligned differently
+    QByteArray bits = qUncompress(compressed);
+    QImage image(width, height, (QImage::Format)format);
+    if (image.isNull() || bits.size() != bytes_per_line * height)
+        return QImage();
+    int length = qMin(bytes_per_line, image.bytesPerLine());
+    for (int y = 0; y < height; y++)
+        memcpy(image.scanLine(y), bits.constData() + y * bytes_per_line,
+               length);
+    return image;
+}
+
+ThumbnailBoxComponents::DiskCache::DiskCache()
+                          : _limit(100 * 1024 * 1024),
+                            _total(0),
+                            _sequence(0)
+{
+}
+
+QString
+ThumbnailBoxComponents::DiskCache::directory()
+const
+{
+    QMutexLocker locker(&_mutex);
+    return _directory;
+}
+
+void
+ThumbnailBoxComponents::DiskCache::setDirectory(const QString &directory)
+{
+    QMutexLocker locker(&_mutex);
+
+    //Forget previous directory
+    _directory.clear();
+    _entries.clear();
+    _lru.clear();
+    _total = 0;
+    if (directory.isEmpty()) return; //disabled
+
+    //Create cache directory
+    QDir dir(directory);
+    if (!dir.mkpath(".")) return; //disabled
+    _directory = dir.absolutePath();
+
+    //Scan existing previews, oldest first
+    //The file time is the time a preview was written,
+    //which is the best guess for the last use after a restart
+    QFileInfoList files = dir.entryInfoList(QDir::Files,
+                                            QDir::Time | QDir::Reversed);
+    foreach (const QFileInfo &file, files)
+    {
+        if (file.fileName().endsWith(".tmp"))
+        {
+            QFile::remove(file.absoluteFilePath()); //interrupted write
+            continue;
+        }
+        _entries[file.fileName()] = qMakePair(file.size(), ++_sequence);
+        _lru[_sequence] = file.fileName();
+        _total += file.size();
+    }
+
+    trim();
+}
+
+qint64
+ThumbnailBoxComponents::DiskCache::limit()
+const
+{
+    QMutexLocker locker(&_mutex);
+    return _limit;
+}
+
+void
+ThumbnailBoxComponents::DiskCache::setLimit(qint64 max_bytes)
+{
+    QMutexLocker locker(&_mutex);
+    _limit = max_bytes;
+    trim();
+}
+
+bool
+ThumbnailBoxComponents::DiskCache::isEnabled()
+const
+{
+    QMutexLocker locker(&_mutex);
+    return !_directory.isEmpty();
+}
+
+QImage
+ThumbnailBoxComponents::DiskCache::load(const QFileInfo &file,
+                                        const QSize &max_size)
+{
+    //Look up preview of this version of the file
+    QString name = entryName(file, max_size);
+    QString path;
+    {
+        QMutexLocker locker(&_mutex);
+        if (!_entries.contains(name)) return QImage(); //not cached
+        touch(name);
+        path = QDir(_directory).filePath(name);
+    }
+
+    //Load preview (not locked, could take a moment)
+    QImage image;
+    if (!image.load(path))
+    {
+        //Broken or deleted by someone else
+        QMutexLocker locker(&_mutex);
+        remove(name);
+    }
+
+    return image;
+}
+
+void
+ThumbnailBoxComponents::DiskCache::store(const QFileInfo &file,
+                                         const QSize &max_size,
+                                         const QImage &image)
+{
+    if (image.isNull()) return;
+    QString name = entryName(file, max_size);
+    QString path;
+    {
+        QMutexLocker locker(&_mutex);
+        if (_directory.isEmpty()) return;
+        path = QDir(_directory).filePath(name);
+    }
+
+    //Write preview (not locked)
+    //Written to a temporary file first, so nobody reads half a preview
+    //Jpeg is small and fast to decode, png is used if there's alpha
+    QString tmp_path = QString("%1.%2.tmp").
+        arg(path).
+        arg((quint64)(quintptr)QThread::currentThreadId());
+    const char *format = image.hasAlphaChannel() ? "PNG" : "JPG";
+    if (!image.save(tmp_path, format, 90))
+    {
+        QFile::remove(tmp_path);
+        return;
+    }
+    QFile::remove(path); //replaced, if it exists
+    if (!QFile::rename(tmp_path, path))
+    {
+        QFile::remove(tmp_path);
+        return;
+    }
+
+    //Add entry, drop old ones if the cache is full
+    qint64 size = QFileInfo(path).size();
+    QMutexLocker locker(&_mutex);
+    remove(name); //replaced
+    _entries[name] = qMakePair(size, ++_sequence);
+    _lru[_sequence] = name;
+    _total += size;
+    trim();
+}
+
+void
+ThumbnailBoxComponents::DiskCache::clear()
+{
+    QMutexLocker locker(&_mutex);
+    QDir dir(_directory);
+    foreach (const QString &name, _entries.keys())
+    {
+        dir.remove(name);
+    }
+    _entries.clear();
+    _lru.clear();
+    _total = 0;
+}
+
+QString
+ThumbnailBoxComponents::DiskCache::entryName(const QFileInfo &file,
+                                             const QSize &max_size)
+{
+    //Preview identified by absolute path, mtime, size (and preview size)
+    QString key = QString("%1\n%2\n%3\n%4x%5").
+        arg(file.absoluteFilePath()).
+        arg(file.lastModified().toMSecsSinceEpoch()).
+        arg(file.size()).
+        arg(max_size.width()).
+        arg(max_size.height());
+    QByteArray hash = QCryptographicHash::hash(key.toUtf8(),
+                                               QCryptographicHash::Sha1);
+    return QString(hash.toHex());
+}
+
+void
+ThumbnailBoxComponents::DiskCache::touch(const QString &name)
+{
+    //Mark entry as recently used (locked)
+    QPair<qint64, qint64> &entry = _entries[name];
+    _lru.remove(entry.second);
+    entry.second = ++_sequence;
+    _lru[entry.second] = name;
+}
+
+void
+ThumbnailBoxComponents::DiskCache::remove(const QString &name)
+{
+    //Forget entry (locked), the file is not deleted
+    if (!_entries.contains(name)) return;
+    QPair<qint64, qint64> entry = _entries.take(name);
+    _lru.remove(entry.second);
+    _total -= entry.first;
+}
+
+void
+ThumbnailBoxComponents::DiskCache::trim()
+{
+    //Delete least recently used previews until the limit is met (locked)
+    QDir dir(_directory);
+    while (_total > _limit && !_lru.isEmpty())
+    {
+        QString name = _lru.first();
+        remove(name);
+        dir.remove(name);
+    }
+}
+
+ThumbnailBoxComponents::Tracer::Tracer()
+                       : _enabled(false),
+                         _gui_thread(0),
+                         _limit(1000000)
+{
+    _clock.start();
+}
+
+bool
+ThumbnailBoxComponents::Tracer::isEnabled()
+const
+{
+    //Only changed by the gui thread, loader threads get the tracer
+    //with their request (if enabled)
+    return _enabled;
+}
+
+void
+ThumbnailBoxComponents::Tracer::setEnabled(bool enable)
+{
+    QMutexLocker locker(&_mutex);
+    _enabled = enable;
+    _gui_thread = currentThread();
+}
+
+/*!
+ * Returns the current time in microseconds (since the tracer was created).
+ */
+qint64
+ThumbnailBoxComponents::Tracer::now()
+const
+{
+    return _clock.nsecsElapsed() / 1000;
+}
+
+/*!
+ * Records a span of the current thread. Name must be a literal.
+ * This is called by loader threads as well (locked).
+ */
+void
+ThumbnailBoxComponents::Tracer::add(const char *name, qint64 start_us,
+                                    qint64 duration_us, const QString &path,
+                                    int index)
+{
+    if (duration_us < 0) return; //not done
+    Event event;
+    event.name = name;
+    event.start_us = start_us;
+    event.duration_us = duration_us;
+    event.thread = currentThread();
+    event.path = path;
+    event.index = index;
+
+    QMutexLocker locker(&_mutex);
+    if (!_enabled || _events.size() >= _limit) return;
+    _events << event;
+}
+
+int
+ThumbnailBoxComponents::Tracer::count()
+const
+{
+    QMutexLocker locker(&_mutex);
+    return _events.size();
+}
+
+void
+ThumbnailBoxComponents::Tracer::clear()
+{
+    QMutexLocker locker(&_mutex);
+    _events.clear();
+}
+
+/*!
+ * Writes the recorded spans as Chrome trace events (complete events).
+ * Threads are numbered, the gui thread first.
+ */
+bool
+ThumbnailBoxComponents::Tracer::write(const QString &file)
+const
+{
+    QFile trace_file(file);
+    if (!trace_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    //Copy events, the loader threads may keep recording
+    QVector<Event> events;
+    quint64 gui_thread;
+    {
+        QMutexLocker locker(&_mutex);
+        events = _events;
+        gui_thread = _gui_thread;
+    }
+
+    //Thread names (metadata events) and spans
+    QString pid = QString::number(QCoreApplication::applicationPid());
+    QString thread_name("{\"name\":\"thread_name\",\"ph\":\"M\","
+                        "\"pid\":%1,\"tid\":%2,\"args\":{\"name\":%3}}");
+    QHash<quint64, int> threads;
+    threads.insert(gui_thread, 1);
+    QByteArray data("{\"traceEvents\":[\n");
+    data += thread_name.arg(pid).arg(1).arg("\"gui\"").toUtf8();
+    bool ok = true;
+    foreach (const Event &event, events)
+    {
+        int tid = threads.value(event.thread);
+        if (!tid)
+        {
+            tid = threads.size() + 1;
+            threads.insert(event.thread, tid);
+            QString name = QString("\"loader %1\"").arg(tid - 1);
+            data += ",\n";
+            data += thread_name.arg(pid).arg(tid).arg(name).toUtf8();
+        }
+        //Appended, the path must not be parsed as a placeholder (arg())
+        data += ",\n{\"name\":\"";
+        data += event.name;
+        data += "\",\"cat\":\"thumbnailbox\",\"ph\":\"X\",\"ts\":";
+        data += QByteArray::number(event.start_us);
+        data += ",\"dur\":";
+        data += QByteArray::number(event.duration_us);
+        data += ",\"pid\":";
+        data += pid.toLatin1();
+        data += ",\"tid\":";
+        data += QByteArray::number(tid);
+        data += ",\"args\":{\"path\":";
+        data += jsonString(event.path);
+        data += ",\"index\":";
+        data += QByteArray::number(event.index);
+        data += "}}";
+
+        //Write in chunks
+        if (data.size() > 1024 * 1024)
+        {
+            ok = ok && trace_file.write(data) == data.size();
+            data.clear();
+        }
+    }
+    data += "\n],\"displayTimeUnit\":\"ms\"}\n";
+    ok = ok && trace_file.write(data) == data.size();
+    return ok;
+}
+
+quint64
+ThumbnailBoxComponents::Tracer::currentThread()
+{
+    return (quint64)(quintptr)QThread::currentThreadId();
+}
+
+QByteArray
+ThumbnailBoxComponents::Tracer::jsonString(const QString &text)
+{
+    //Quoted and escaped (paths may contain anything)
+    QByteArray utf8 = text.toUtf8();
+    QByteArray string("\"");
+    for (int i = 0; i < utf8.size(); i++)
+    {
+        char c = utf8.at(i);
+        if (c == '"' || c == '\\')
+            string += '\\';
+        if ((uchar)c < 0x20)
+            string += QString("\\u%1").arg((int)(uchar)c, 4, 16, QChar('0'))
+                                        .toLatin1();
+        else
+            string += c;
+    }
+    string += '"';
+    return string;
+}
+
+ThumbnailBoxComponents::TraceSpan::TraceSpan(Tracer *tracer, const char *name,
+                                             const QString &path, int index)
+                           : tracer(tracer)
+{
+    //Nothing is done if tracing is disabled (no tracer)
+    if (!tracer) return;
+    this->name = name;
+    this->path = path;
+    this->index = index;
+    start = tracer->now();
+}
+
+ThumbnailBoxComponents::TraceSpan::~TraceSpan()
+{
+    if (!tracer) return;
+    tracer->add(name, start, tracer->now() - start, path, index);
+}
+
+ThumbnailBoxComponents::InputRecorder::InputRecorder()
+{
+}
+
+bool
+ThumbnailBoxComponents::InputRecorder::isRecording()
+const
+{
+    return _file.isOpen();
+}
+
+bool
+ThumbnailBoxComponents::InputRecorder::start(const QString &file)
+{
+    stop();
+    _file.setFileName(file);
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    _file.write("#ThumbnailBox input recording\n");
+    _clock.start();
+    return true;
+}
+
+void
+ThumbnailBoxComponents::InputRecorder::stop()
+{
+    if (_file.isOpen()) _file.close();
+}
+
+void
+ThumbnailBoxComponents::InputRecorder::record(const QString &event)
+{
+    //One line per event, written right away (input is rare)
+    QString line = QString("%1 %2\n").arg(_clock.elapsed()).arg(event);
+    _file.write(line.toUtf8());
+    _file.flush();
+}
+
+ThumbnailBoxComponents::Loader::Timing::Timing()
+                               : decode_us(-1),
+                                 shrink_us(-1)
+{
+}
+
+ThumbnailBoxComponents::Loader::Loader(QObject *parent)
+                       : QObject(parent),
+                         _jobs(0),
+                         _thread_count(0)
+{
+    //Default number of loader threads
+    setThreadCount(QThread::idealThreadCount());
+
+    //Loaded images are passed from the loader thread to this (gui) thread
+    connect(this,
+            SIGNAL(loaded(const QString&, const QImage&)),
+            SLOT(deliver(const QString&, const QImage&)),
+            Qt::QueuedConnection);
+
+}
+
+ThumbnailBoxComponents::Loader::~Loader()
+{
+    //Drop queued requests, wait for running jobs
+    //Results of running jobs will not be delivered anymore
+    clear();
+    _pool.waitForDone();
+}
+
+static qint64
+lapTime(QElapsedTimer &timer)
+{
+    //Microseconds since the timer was started, then it's restarted
+    qint64 microseconds = timer.nsecsElapsed() / 1000;
+    timer.start();
+    return microseconds;
+}
+
+/*!
+ * Loads the requested image and shrinks it.
+ * This is called by a loader thread, unless the loader is synchronous.
+ * If timing is set, the time spent on decoding and shrinking is stored.
+ */
+QImage
+ThumbnailBoxComponents::Loader::loadImage(const Request &request,
+                                          Timing *timing)
+{
+    Timing unused;
+    if (!timing) timing = &unused;
+    QElapsedTimer timer;
+    timer.start();
+
+    QImage image;
+    switch (request.type)
+    {
+        case ThumbnailBox::SourceType::Local:
+        //Load image directly from file (path points to file)
+        return loadFile(request, timing);
+
+        case ThumbnailBox::SourceType::LoaderFunction:
+        //Call external function which returns QImage
+        if (request.function)
+            image = request.function(request.path);
+        timing->decode_us = lapTime(timer);
+        break;
+
+        case ThumbnailBox::SourceType::External:
+        //Not loaded by us
+        break;
+
+        case ThumbnailBox::SourceType::LoaderObject:
+        //Loaded in batches, see LoadJob::run()
+        break;
+
+    }
+
+    //Shrink image right here, only the small one is passed on
+    image = ThumbnailBox::shrinkImage(image, request.max_size);
+    timing->shrink_us = lapTime(timer);
+    return image;
+}
+
+/*!
+ * Loads the preview of a local file (Local source type) and shrinks it.
+ *
+ * The fastest source is tried first: The disk cache (if enabled),
+ * then the thumbnail embedded in the Exif header (if big enough),
+ * then the image itself. The Exif orientation is applied.
+ */
+QImage
+ThumbnailBoxComponents::Loader::loadFile(const Request &request,
+                                         Timing *timing)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    //Check disk cache first, it's a small preview (already shrunk)
+    QFileInfo file(request.path);
+    bool disk_cache = request.disk_cache && request.disk_cache->isEnabled();
+    if (disk_cache)
+    {
+        QImage image = request.disk_cache->load(file, request.max_size);
+        if (!image.isNull())
+        {
+            timing->decode_us = lapTime(timer);
+            return image;
+        }
+    }
+
+    //Read Exif header (only a few KB at the beginning of a jpeg file)
+    int orientation = 1;
+    QByteArray exif_thumbnail;
+    readExif(request.path, orientation,
+             request.embedded_thumbnails ? &exif_thumbnail : 0);
+
+    //Use embedded thumbnail if it's big enough for the thumbnail widget
+    //It's not stored in the disk cache, it might be too small next time
+    if (!exif_thumbnail.isEmpty())
+    {
+        QImage image = QImage::fromData(exif_thumbnail, "JPG");
+        image = orientImage(image, orientation);
+        if (!image.isNull() &&
+            qMax(image.width(), image.height()) >= request.min_size)
+        {
+            timing->decode_us = lapTime(timer);
+            image = ThumbnailBox::shrinkImage(image, request.max_size);
+            timing->shrink_us = lapTime(timer);
+            return image;
+        }
+    }
+
+    //Decode image (rotated by 90 degrees, if the orientation says so)
+    QSize max_size(request.max_size);
+    if (orientation >= 5)
+        max_size = QSize(max_size.height(), max_size.width());
+    QImage image = decodeImage(request.path, max_size);
+    image = orientImage(image, orientation);
+    timing->decode_us = lapTime(timer);
+    image = ThumbnailBox::shrinkImage(image, request.max_size);
+    timing->shrink_us = lapTime(timer);
+
+    //Keep preview on disk for next time
+    if (disk_cache)
+        request.disk_cache->store(file, request.max_size, image);
+
+    return image;
+}
+
+/*!
+ * Reads the Exif header of a jpeg file.
+ * Sets the orientation (1 - 8, 1 is normal) if it's defined.
+ * If thumbnail is set, the embedded jpeg thumbnail is copied to it.
+ * Returns false if there's no Exif header.
+ *
+ * Only the header segments of the file are read,
+ * the image data is never touched.
+ */
+bool
+ThumbnailBoxComponents::Loader::readExif(const QString &path,
+                                         int &orientation,
+                                         QByteArray *thumbnail)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    //Jpeg start of image marker
+    uchar marker[4];
+    if (file.read((char*)marker, 2) != 2) return false;
+    if (marker[0] != 0xFF || marker[1] != 0xD8) return false; //not jpeg
+
+    //Walk through header segments, Exif should be one of the first ones
+    for (int i = 0; i < 16; i++)
+    {
+        if (file.read((char*)marker, 4) != 4) return false;
+        if (marker[0] != 0xFF) return false; //broken
+        int type = marker[1];
+        int length = (marker[2] << 8) | marker[3]; //incl. length field
+        if (type == 0xDA || type == 0xD9 || length < 2)
+            return false; //image data reached, no Exif
+        if (type != 0xE1)
+        {
+            //Skip segment
+            if (!file.seek(file.pos() + length - 2)) return false;
+            continue;
+        }
+
+        //App1 segment, Exif (could also be xmp)
+        QByteArray segment = file.read(length - 2);
+        if (segment.size() != length - 2) return false;
+        if (!segment.startsWith(QByteArray("Exif\0\0", 6))) continue;
+        return parseExif(segment.mid(6), orientation, thumbnail);
+    }
+
+    return false;
+}
+
+static quint16
+exifShort(const uchar *data, bool le)
+{
+    return le ? qFromLittleEndian<quint16>(data) :
+                qFromBigEndian<quint16>(data);
+}
+
+static quint32
+exifLong(const uchar *data, bool le)
+{
+    return le ? qFromLittleEndian<quint32>(data) :
+                qFromBigEndian<quint32>(data);
+}
+
+/*!
+ * Parses the tiff structure of an Exif header, see readExif().
+ */
+bool
+ThumbnailBoxComponents::Loader::parseExif(const QByteArray &tiff,
+                                          int &orientation,
+                                          QByteArray *thumbnail)
+{
+    const uchar *data = (const uchar*)tiff.constData();
+    qint64 size = tiff.size();
+    if (size < 8) return false;
+
+    //Byte order
+    bool le;
+    if (data[0] == 'I' && data[1] == 'I') le = true;
+    else if (data[0] == 'M' && data[1] == 'M') le = false;
+    else return false;
+
+    //First directory (IFD0), main image, contains the orientation
+    qint64 ifd = exifLong(data + 4, le);
+    if (ifd + 2 > size) return false;
+    qint64 count = exifShort(data + ifd, le);
+    if (ifd + 2 + count * 12 + 4 > size) return false;
+    for (int i = 0; i < count; i++)
+    {
+        const uchar *entry = data + ifd + 2 + i * 12;
+        if (exifShort(entry, le) == 0x0112)
+        {
+            int value = exifShort(entry + 8, le);
+            if (value >= 1 && value <= 8) orientation = value;
+        }
+    }
+    if (!thumbnail) return true;
+
+    //Second directory (IFD1), thumbnail
+    ifd = exifLong(data + ifd + 2 + count * 12, le);
+    if (!ifd || ifd + 2 > size) return true; //no thumbnail
+    count = exifShort(data + ifd, le);
+    if (ifd + 2 + count * 12 > size) return true;
+    qint64 offset = 0;
+    qint64 length = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const uchar *entry = data + ifd + 2 + i * 12;
+        int tag = exifShort(entry, le);
+        if (tag == 0x0201) offset = exifLong(entry + 8, le);
+        else if (tag == 0x0202) length = exifLong(entry + 8, le);
+    }
+    if (offset > 0 && length > 0 && offset + length <= size)
+        *thumbnail = tiff.mid(offset, length);
+
+    return true;
+}
+
+/*!
+ * Returns a copy of image rotated and/or mirrored according to
+ * the given Exif orientation (1 - 8).
+ */
+QImage
+ThumbnailBoxComponents::Loader::orientImage(const QImage &image,
+                                            int orientation)
+{
+    if (image.isNull()) return image;
+
+    //Rotation is clockwise, 5 and 7 are rotated and mirrored
+    QTransform transform;
+    switch (orientation)
+    {
+        case 2: return image.mirrored(true, false);
+        case 3: return image.transformed(transform.rotate(180));
+        case 4: return image.mirrored(false, true);
+        case 5: return image.transformed(transform.rotate(90)).
+                      mirrored(true, false);
+        case 6: return image.transformed(transform.rotate(90));
+        case 7: return image.transformed(transform.rotate(90)).
+                      mirrored(false, true);
+        case 8: return image.transformed(transform.rotate(270));
+    }
+
+    return image;
+}
+
+/*!
+ * Decodes the image file, at (about) the preview size if possible.
+ * Some decoders (jpeg) can decode a smaller version of the image directly,
+ * which is much faster and needs a fraction of the memory.
+ * Other formats are decoded at full size (and shrunk later).
+ */
+QImage
+ThumbnailBoxComponents::Loader::decodeImage(const QString &path,
+                                            const QSize &max_size)
+{
+    //Image size from file header
+    QImageReader reader(path);
+    QSize size = reader.size();
+
+    //Ask decoder for preview size (if it's bigger and the format can do it)
+    //Otherwise, QImageReader would decode it fully and scale it (slowly)
+    if (size.isValid() && !max_size.isEmpty() &&
+        (size.width() > max_size.width() ||
+        size.height() > max_size.height()) &&
+        reader.supportsOption(QImageIOHandler::ScaledSize))
+    {
+        size.scale(max_size, Qt::KeepAspectRatio);
+        reader.setScaledSize(size);
+    }
+
+    return reader.read();
+}
+
+/*!
+ * Records the decode and shrink spans of a request that has been
+ * loaded (if tracing was enabled when it was requested).
+ * Both follow each other, starting at start_us.
+ */
+void
+ThumbnailBoxComponents::Loader::trace(const Request &request,
+                                      qint64 start_us, const Timing &timing)
+{
+    if (!request.tracer) return;
+    qint64 decode_us = qMax(timing.decode_us, Q_INT64_C(0));
+    request.tracer->add("decode", start_us, timing.decode_us, request.path);
+    request.tracer->add("shrinkImage", start_us + decode_us, timing.shrink_us,
+                        request.path);
+}
+
+int
+ThumbnailBoxComponents::Loader::threadCount()
+const
+{
+    return _thread_count;
+}
+
+void
+ThumbnailBoxComponents::Loader::setThreadCount(int count)
+{
+    if (count < 0) count = 0;
+    _thread_count = count;
+    if (count) _pool.setMaxThreadCount(count);
+}
+
+void
+ThumbnailBoxComponents::Loader::enqueue(const Request &request)
+{
+    //Queue request, unless this image is already queued
+    //If it is, it gets the higher priority of both
+    {
+        QMutexLocker locker(&_mutex);
+        for (int i = 0; i < _queue.size(); i++)
+        {
+            Request &queued = _queue[i];
+            if (queued.path != request.path) continue;
+            queued.priority = qMin(queued.priority, request.priority);
+            return;
+        }
+        _queue << request;
+
+        //Start another job, unless all threads are busy already
+        //Jobs keep taking requests from the queue until it's empty
+        if (_jobs >= _thread_count) return;
+        _jobs++;
+    }
+
+    _pool.start(new LoadJob(this));
+}
+
+QStringList
+ThumbnailBoxComponents::Loader::retain(const QHash<QString, int> &wanted)
+{
+    //Drop queued requests that are not wanted anymore,
+    //update the priority of the others
+    //Returns the dropped ones
+    QStringList dropped;
+    QMutexLocker locker(&_mutex);
+    for (int i = _queue.size() - 1; i >= 0; i--)
+    {
+        Request &queued = _queue[i];
+        if (wanted.contains(queued.path))
+        {
+            queued.priority = wanted.value(queued.path);
+        }
+        else
+        {
+            dropped << _queue.takeAt(i).path;
+        }
+    }
+    return dropped;
+}
+
+void
+ThumbnailBoxComponents::Loader::releaseImageLoader(ImageLoader *image_loader,
+                                                   bool destroy)
+{
+    //Drop queued requests for this loader object
+    //If it should be deleted, that's done once no job is using it,
+    //see finishBatch()
+    QMutexLocker locker(&_mutex);
+    for (int i = _queue.size() - 1; i >= 0; i--)
+    {
+        if (_queue.at(i).image_loader != image_loader) continue;
+        _queue.removeAt(i);
+    }
+    if (!destroy) return;
+    if (_busy_loaders.contains(image_loader))
+        _retired_loaders.insert(image_loader);
+    else
+        image_loader->deleteLater();
+}
+
+void
+ThumbnailBoxComponents::Loader::clear()
+{
+    //Drop queued requests (running jobs are not interrupted)
+    QMutexLocker locker(&_mutex);
+    _queue.clear();
+}
+
+ThumbnailBoxComponents::DiskCache*
+ThumbnailBoxComponents::Loader::diskCache()
+{
+    return &_disk_cache;
+}
+
+ThumbnailBoxComponents::Tracer*
+ThumbnailBoxComponents::Loader::tracer()
+{
+    return &_tracer;
+}
+
+void
+ThumbnailBoxComponents::Loader::addTiming(const Timing &timing)
+{
+    //Called by loader threads (locked)
+    QMutexLocker locker(&_mutex);
+    _decode_time.add(timing.decode_us);
+    _shrink_time.add(timing.shrink_us);
+}
+
+void
+ThumbnailBoxComponents::Loader::timing(ThumbnailBox::Histogram &decode_time,
+                                       ThumbnailBox::Histogram &shrink_time)
+const
+{
+    QMutexLocker locker(&_mutex);
+    decode_time = _decode_time;
+    shrink_time = _shrink_time;
+}
+
+void
+ThumbnailBoxComponents::Loader::resetTiming()
+{
+    QMutexLocker locker(&_mutex);
+    _decode_time = ThumbnailBox::Histogram();
+    _shrink_time = ThumbnailBox::Histogram();
+}
+
+void
+ThumbnailBoxComponents::Loader::deliver(const QString &path,
+                                        const QImage &image)
+{
+    //Gui thread (queued), see constructor
+    emit imageLoaded(path, image);
+}
+
+bool
+ThumbnailBoxComponents::Loader::takeRequest(Request &request)
+{
+    QMutexLocker locker(&_mutex);
+    if (_queue.isEmpty())
+    {
+        //Nothing to do, job ends
+        _jobs--;
+        return false;
+    }
+
+    //Most important request (lowest value), oldest first
+    int next = 0;
+    for (int i = 1; i < _queue.size(); i++)
+    {
+        if (_queue.at(i).priority < _queue.at(next).priority) next = i;
+    }
+    request = _queue.takeAt(next);
+
+    //Loader object is in use until the batch is finished
+    if (request.type == ThumbnailBox::SourceType::LoaderObject)
+        _busy_loaders[request.image_loader]++;
+    return true;
+}
+
+QStringList
+ThumbnailBoxComponents::Loader::takeBatch(const Request &request)
+{
+    //Take more requests for the same loader object (and size),
+    //most important first, up to its batch size
+    QStringList paths;
+    paths << request.path;
+    int batch_size = request.image_loader->batchSize();
+    QMutexLocker locker(&_mutex);
+    while (paths.size() < batch_size)
+    {
+        int next = -1;
+        for (int i = 0; i < _queue.size(); i++)
+        {
+            const Request &queued = _queue.at(i);
+            if (queued.image_loader != request.image_loader) continue;
+            if (queued.max_size != request.max_size) continue;
+            if (next == -1 || queued.priority < _queue.at(next).priority)
+                next = i;
+        }
+        if (next == -1) break;
+        paths << _queue.takeAt(next).path;
+    }
+    return paths;
+}
+
+void
+ThumbnailBoxComponents::Loader::finishBatch(const Request &request)
+{
+    //Requests passed to loader object, which delivers the images itself
+    //If it has been released in the meantime, it can be deleted now
+    QMutexLocker locker(&_mutex);
+    ImageLoader *image_loader = request.image_loader;
+    if (--_busy_loaders[image_loader]) return;
+    _busy_loaders.remove(image_loader);
+    if (_retired_loaders.remove(image_loader)) image_loader->deleteLater();
+}
+
+void
+ThumbnailBoxComponents::Loader::finishRequest(const QString &path,
+                                              const QImage &image)
+{
+    //Called by loader thread, delivered in gui thread (queued)
+    emit loaded(path, image);
+}
+
+/*!
+ * Compresses the image in a loader thread, compressed() is emitted
+ * with the result. The ticket is passed back, it identifies the request.
+ */
+void
+ThumbnailBoxComponents::Loader::compress(const QString &key, int ticket,
+                                         const QImage &image)
+{
+    _pool.start(new CompressJob(this, key, ticket, image));
+}
+
+void
+ThumbnailBoxComponents::Loader::finishCompression(const QString &key,
+                                                  int ticket,
+                                                  const QByteArray &data)
+{
+    //Called by loader thread, receiver is in gui thread (queued)
+    emit compressed(key, ticket, data);
+}
+
+ThumbnailBoxComponents::LoadJob::LoadJob(Loader *loader)
+                       : loader(loader)
+{
+}
+
+void
+ThumbnailBoxComponents::LoadJob::run()
+{
+    //Take next request until the queue is empty
+    //The most important request is taken first, see Loader::retain()
+    Loader::Request request;
+    while (loader->takeRequest(request))
+    {
+        //Loader object, pass it a batch of requests
+        //It delivers the images itself (now or later)
+        if (request.type == ThumbnailBox::SourceType::LoaderObject)
+        {
+            QStringList paths = loader->takeBatch(request);
+            request.image_loader->load(paths, request.max_size);
+            loader->finishBatch(request);
+            continue;
+        }
+
+        //Load and shrink image in this thread
+        Loader::Timing timing;
+        qint64 start = request.tracer ? request.tracer->now() : 0;
+        QImage image = Loader::loadImage(request, &timing);
+        loader->addTiming(timing);
+        Loader::trace(request, start, timing);
+        loader->finishRequest(request.path, image);
+    }
+}
+
+
+ThumbnailBoxComponents::CompressJob::CompressJob(Loader *loader,
+                                                 const QString &key,
+                                                 int ticket,
+                                                 const QImage &image)
+                           : loader(loader),
+                             key(key),
+                             ticket(ticket),
+                             image(image)
+{
+}
+
+void
+ThumbnailBoxComponents::CompressJob::run()
+{
+    loader->finishCompression(key, ticket, CachedImage::compress(image));
+}
+
+ThumbnailBoxComponents::Validator::Validator(QObject *parent)
+                          : QObject(parent),
+                            _generation(0),
+                            _checked(0),
+                            _total(0)
+{
+    //Checking paths is mostly waiting for the (network) file system,
+    //so more threads than cores are used
+    _pool.setMaxThreadCount(qMax(4, QThread::idealThreadCount() * 2));
+
+    //Results are passed from the validator threads to this (gui) thread
+    connect(this,
+            SIGNAL(checked(int, const QStringList&, int)),
+            SLOT(deliver(int, const QStringList&, int)),
+            Qt::QueuedConnection);
+
+}
+
+ThumbnailBoxComponents::Validator::~Validator()
+{
+    //Stop running jobs and wait for them
+    cancel();
+    _pool.waitForDone();
+}
+
+/*!
+ * Returns true if the local path points to a file
+ * or to a directory, if directories are accepted.
+ */
+bool
+ThumbnailBoxComponents::Validator::isValidPath(const QString &path,
+                                               bool directories)
+{
+    QFileInfo inf(path);
+    return inf.isFile() || (directories && inf.isDir());
+}
+
+bool
+ThumbnailBoxComponents::Validator::isRunning()
+const
+{
+    return _checked < _total;
+}
+
+/*!
+ * Starts checking the paths in the background, cancelling the previous run.
+ * The paths are split into chunks which are checked in parallel.
+ */
+void
+ThumbnailBoxComponents::Validator::start(const QStringList &paths,
+                                         bool directories)
+{
+    const int chunk_size = 256;
+
+    int generation;
+    {
+        QMutexLocker locker(&_mutex);
+        generation = ++_generation;
+    }
+    _checked = 0;
+    _total = paths.size();
+
+    for (int i = 0; i < paths.size(); i += chunk_size)
+    {
+        QStringList chunk = paths.mid(i, chunk_size);
+        _pool.start(new ValidateJob(this, generation, chunk, directories));
+    }
+}
+
+/*!
+ * Cancels the current run. Running jobs stop after their current path,
+ * results that have not been delivered yet are dropped.
+ */
+void
+ThumbnailBoxComponents::Validator::cancel()
+{
+    QMutexLocker locker(&_mutex);
+    _generation++;
+    _checked = 0;
+    _total = 0;
+}
+
+void
+ThumbnailBoxComponents::Validator::deliver(int generation,
+                                           const QStringList &invalid_paths,
+                                           int count)
+{
+    //Drop results of a cancelled run
+    if (!isCurrent(generation)) return;
+
+    _checked += count;
+    emit validated(invalid_paths, _checked, _total);
+    if (_checked >= _total) emit finished();
+}
+
+bool
+ThumbnailBoxComponents::Validator::isCurrent(int generation)
+const
+{
+    QMutexLocker locker(&_mutex);
+    return generation == _generation;
+}
+
+void
+ThumbnailBoxComponents::Validator::finishChunk(int generation,
+                                               const QStringList &invalid_paths,
+                                               int count)
+{
+    //Called by validator thread, delivered in gui thread (queued)
+    emit checked(generation, invalid_paths, count);
+}
+
+ThumbnailBoxComponents::ValidateJob::ValidateJob(Validator *validator,
+                                                 int generation,
+                                                 const QStringList &paths,
+                                                 bool directories)
+                           : validator(validator),
+                             generation(generation),
+                             paths(paths),
+                             directories(directories)
+{
+}
+
+void
+ThumbnailBoxComponents::ValidateJob::run()
+{
+    //Check all paths in this chunk, unless the run is cancelled
+    QStringList invalid_paths;
+    foreach (const QString &path, paths)
+    {
+        if (!validator->isCurrent(generation)) return;
+        if (!Validator::isValidPath(path, directories))
+            invalid_paths << path;
+    }
+    validator->finishChunk(generation, invalid_paths, paths.size());
+}
+
+/*! \class ThumbnailBoxComponents::ImageLoader
+ *
+ * \brief Loads images for a ThumbnailBox, in batches.
+ *
+ * A subclass implements load(), which is called from a loader thread
+ * with a batch of paths and the size of the thumbnails.
+ * Images should be about that size, bigger ones are shrunk.
+ * It may load them right away or start loading them
+ * asynchronously and return, either way every image is passed
+ * to deliver() once it's ready, in batches or one by one,
+ * from any thread. An empty image means that it couldn't be loaded.
+ * Every requested path must be delivered.
+ */
+
+ThumbnailBoxComponents::ImageLoader::ImageLoader(QObject *parent)
+                            : QObject(parent)
+{
+}
+
+/*!
+ * Returns the maximum number of paths passed to load() at once.
+ */
+int
+ThumbnailBoxComponents::ImageLoader::batchSize()
+const
+{
+    return 64;
+}
+
+/*!
+ * Delivers loaded images to the ThumbnailBox, see cacheImages().
+ * This may be called from any thread.
+ */
+void
+ThumbnailBoxComponents::ImageLoader::deliver(const QStringList &paths,
+                                             const QList<QImage> &images)
+{
+    emit loaded(paths, images);
+}
+
+/*!
+ * This is a convenience function.
+ */
+void
+ThumbnailBoxComponents::ImageLoader::deliver(const QString &path,
+                                             const QImage &image)
+{
+    deliver(QStringList() << path, QList<QImage>() << image);
+}
+
+ThumbnailBoxComponents::FunctionImageLoader::FunctionImageLoader(
+    const Function &function, QObject *parent)
+                                    : ImageLoader(parent),
+                                      _function(function)
+{
+}
+
+void
+ThumbnailBoxComponents::FunctionImageLoader::load(const QStringList &paths,
+                                                  const QSize &size)
+{
+    //Call function for each path, deliver all images at once
+    QList<QImage> images;
+    foreach (const QString &path, paths)
+    {
+        images << (_function ? _function(path, size) : QImage());
+    }
+    deliver(paths, images);
+}
+
+/*! \class ThumbnailBoxComponents::ItemProvider
+ *
+ * \brief ItemProvider provides the items of a ThumbnailBox.
+ *
+ * A provider must return the number of items and the address (path)
+ * of an item at a given index. The ThumbnailBox only asks
+ * for the items it shows (or prefetches), in the gui thread.
+ *
+ * Titles are taken from the addresses, unless title() is reimplemented.
+ * indexOf() should be reimplemented if the provider can find an item
+ * by its address, it's used for the selection and by indexOf().
+ *
+ * If items have changed, itemsChanged() should be emitted.
+ * If items have been added or removed, itemsReset() should be emitted.
+ *
+ */
+
+ThumbnailBoxComponents::ItemProvider::ItemProvider(QObject *parent)
+                             : QObject(parent)
+{
+}
+
+/*!
+ * Returns the title of the item, an empty title means that it's
+ * taken from the address.
+ */
+QString
+ThumbnailBoxComponents::ItemProvider::title(int index)
+const
+{
+    Q_UNUSED(index);
+    return QString();
+}
+
+/*!
+ * Returns the index of the item with the given address,
+ * -1 if it's not found (or if the provider can't search).
+ */
+int
+ThumbnailBoxComponents::ItemProvider::indexOf(const QString &path)
+const
+{
+    Q_UNUSED(path);
+    return -1;
+}
+
+/*! \class ThumbnailBoxComponents::ListProvider
+ *
+ * \brief ListProvider provides the items of a list, see setList().
+ *
+ * Paths are stored compactly, a list of a million paths would
+ * otherwise take hundreds of MB: Directories are stored once,
+ * file names are stored in one string (arena), next to each other.
+ * Paths are put together again when they're needed.
+ * The index (for indexOf()) is a sorted array of path hashes.
+ *
+ */
+
+ThumbnailBoxComponents::ListProvider::ListProvider(QObject *parent)
+                             : ItemProvider(parent)
+{
+}
+
+QStringList
+ThumbnailBoxComponents::ListProvider::list()
+const
+{
+    QStringList list;
+    list.reserve(count());
+    for (int i = 0; i < count(); i++)
+        list << path(i);
+    return list;
+}
+
+void
+ThumbnailBoxComponents::ListProvider::setList(const QStringList &list)
+{
+    //Drop old list (and its memory)
+    _directories = QStringList();
+    _names = QString();
+    _entries = QVector<Entry>();
+    _index = QVector<QPair<uint, int>>();
+    if (list.isEmpty()) return;
+
+    //Size of the arena
+    int names_size = 0;
+    foreach (const QString &path, list)
+        names_size += path.size() - (path.lastIndexOf('/') + 1);
+    _names.reserve(names_size);
+    _entries.reserve(list.size());
+    _index.reserve(list.size());
+
+    //Split paths into directory (incl. slash) and file name
+    //Paths of the same directory usually follow each other,
+    //the directory is only looked up (and copied) if it changes
+    QHash<QString, int> directory_ids;
+    int directory = -1;
+    for (int i = 0; i < list.size(); i++)
+    {
+        const QString &path = list.at(i);
+        int slash = path.lastIndexOf('/') + 1; //0 if none
+        if (directory == -1 ||
+            path.leftRef(slash) != _directories.at(directory))
+        {
+            QString directory_path = path.left(slash);
+            directory = directory_ids.value(directory_path, -1);
+            if (directory == -1)
+            {
+                directory = _directories.size();
+                directory_ids.insert(directory_path, directory);
+                _directories << directory_path;
+            }
+        }
+
+        Entry entry;
+        entry.directory = directory;
+        entry.offset = _names.size();
+        entry.length = path.size() - slash;
+        _entries << entry;
+        _names += path.midRef(slash);
+        _index << qMakePair(qHash(path), i);
+    }
+
+    //Sorted by hash, then position (the first occurrence is found first)
+    std::sort(_index.begin(), _index.end());
+}
+
+int
+ThumbnailBoxComponents::ListProvider::remove(const QSet<QString> &paths)
+{
+    //Remove all occurrences of the given paths, returns how many
+    //The list is compacted in place, other paths are not put together
+    //Names of removed paths stay in the arena until the next list is set
+
+    //Find items through the index, removed ones are marked (-1)
+    QVector<int> positions(count(), 0);
+    int removed = 0;
+    foreach (const QString &path, paths)
+    {
+        QPair<uint, int> key(qHash(path), -1);
+        QVector<QPair<uint, int>>::const_iterator it =
+            std::lower_bound(_index.constBegin(), _index.constEnd(), key);
+        for (; it != _index.constEnd() && it->first == key.first; ++it)
+        {
+            if (positions.at(it->second) == -1) continue;
+            if (!matches(it->second, path)) continue;
+            positions[it->second] = -1;
+            removed++;
+        }
+    }
+    if (!removed) return 0;
+
+    //Move remaining entries up, remember their new positions
+    int size = 0;
+    for (int i = 0; i < _entries.size(); i++)
+    {
+        if (positions.at(i) == -1) continue;
+        positions[i] = size;
+        _entries[size++] = _entries.at(i);
+    }
+    _entries.resize(size);
+
+    //Same for the index, positions keep their order (still sorted)
+    size = 0;
+    for (int i = 0; i < _index.size(); i++)
+    {
+        int position = positions.at(_index.at(i).second);
+        if (position == -1) continue;
+        _index[size++] = qMakePair(_index.at(i).first, position);
+    }
+    _index.resize(size);
+
+    return removed;
+}
+
+int
+ThumbnailBoxComponents::ListProvider::count()
+const
+{
+    return _entries.size();
+}
+
+QString
+ThumbnailBoxComponents::ListProvider::path(int index)
+const
+{
+    const Entry &entry = _entries.at(index);
+    const QString &directory = _directories.at(entry.directory);
+    QString path;
+    path.reserve(directory.size() + entry.length);
+    path += directory;
+    path += _names.midRef(entry.offset, entry.length);
+    return path;
+}
+
+int
+ThumbnailBoxComponents::ListProvider::indexOf(const QString &path)
+const
+{
+    //Items with the same hash, the position decides if it's a collision
+    QPair<uint, int> key(qHash(path), -1);
+    QVector<QPair<uint, int>>::const_iterator it =
+        std::lower_bound(_index.constBegin(), _index.constEnd(), key);
+    for (; it != _index.constEnd() && it->first == key.first; ++it)
+    {
+        if (matches(it->second, path)) return it->second;
+    }
+    return -1;
+}
+
+bool
+ThumbnailBoxComponents::ListProvider::matches(int index,
+                                              const QString &path)
+const
+{
+    //Compare without putting the path together
+    const Entry &entry = _entries.at(index);
+    const QString &directory = _directories.at(entry.directory);
+    if (path.size() != directory.size() + entry.length) return false;
+    return path.leftRef(directory.size()) == directory &&
+           path.midRef(directory.size()) ==
+           _names.midRef(entry.offset, entry.length);
+}